@@ -0,0 +1,65 @@
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief multi-threaded allocation throughput benchmark
+///
+/// each thread repeatedly allocates and frees small blocks, keeping a small
+/// working set of live blocks. run it standalone and under louse with 
+/// increasing thread counts to see how louse's heap scales, e.g.
+///
+///   ./out/bench-heap-threads 8
+///   LD_PRELOAD=./out/liblouse.so LOUSE_WITHTRACES=no ./out/bench-heap-threads 8
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static int const WorkingSet = 256;
+
+static void worker (unsigned long iterations, unsigned int seed) {
+  void* blocks[WorkingSet] = { nullptr };
+
+  for (unsigned long i = 0; i < iterations; ++i) {
+    seed = seed * 1103515245 + 12345;
+    int slot = (seed >> 8) % WorkingSet;
+
+    ::free(blocks[slot]);
+    blocks[slot] = ::malloc(16 + (seed >> 16) % 240);
+  }
+
+  for (int i = 0; i < WorkingSet; ++i) {
+    ::free(blocks[i]);
+  }
+}
+
+int main (int argc, char* argv[]) {
+  int threads = (argc > 1 ? ::atoi(argv[1]) : 1);
+  unsigned long iterations = (argc > 2 ? ::strtoul(argv[2], nullptr, 10) : 1000000);
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(worker, iterations, static_cast<unsigned int>(i + 1));
+  }
+  for (auto& it : workers) {
+    it.join();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  double ops = static_cast<double>(threads) * iterations * 2;
+
+  ::printf("threads: %d, operations: %.0f, time: %.3f s, throughput: %.2f Mops/s\n", 
+           threads, 
+           ops, 
+           elapsed.count(), 
+           ops / elapsed.count() / 1000000.0);
+
+  return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# runs the heap throughput benchmark standalone and under louse with 
+# increasing thread counts
+# usage: bench/heap-threads.sh [max-threads] [iterations-per-thread]
+
+MAXTHREADS="${1:-`nproc`}"
+ITERATIONS="${2:-1000000}"
+BENCH="`dirname $0`/../out/bench-heap-threads"
+LIBRARY="`dirname $0`/../out/liblouse.so"
+
+THREADS=1
+while [ "$THREADS" -le "$MAXTHREADS" ]; do
+  echo -n "native: "
+  "$BENCH" "$THREADS" "$ITERATIONS"
+  echo -n "louse:  "
+  LOUSE_WITHTRACES=no LOUSE_WITHLEAKS=no LD_PRELOAD="$LIBRARY" "$BENCH" "$THREADS" "$ITERATIONS" 2>/dev/null | grep threads
+  THREADS=$((THREADS * 2))
+done
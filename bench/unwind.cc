@@ -0,0 +1,54 @@
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief stacktrace capturing benchmark
+///
+/// allocates and frees small blocks from a configurable call depth, so the
+/// cost of each allocation under louse is dominated by capturing its 
+/// stacktrace. run it under louse with the different unwinders, e.g.
+///
+///   LD_PRELOAD=./out/liblouse.so LOUSE_UNWINDER=libunwind ./out/bench-unwind 20
+///   LD_PRELOAD=./out/liblouse.so LOUSE_UNWINDER=fp ./out/bench-unwind 20
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static void* volatile Sink;
+
+static __attribute__ ((noinline)) void allocate (unsigned long iterations) {
+  for (unsigned long i = 0; i < iterations; ++i) {
+    Sink = ::malloc(32);
+    ::free(Sink);
+  }
+}
+
+static __attribute__ ((noinline)) void recurse (int depth, unsigned long iterations) {
+  if (depth <= 1) {
+    allocate(iterations);
+  }
+  else {
+    recurse(depth - 1, iterations);
+  }
+  // prevent the recursion from becoming a tail call
+  asm volatile ("" ::: "memory");
+}
+
+int main (int argc, char* argv[]) {
+  int depth = (argc > 1 ? ::atoi(argv[1]) : 16);
+  unsigned long iterations = (argc > 2 ? ::strtoul(argv[2], nullptr, 10) : 1000000);
+
+  auto start = std::chrono::steady_clock::now();
+
+  recurse(depth, iterations);
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  ::printf("depth: %d, allocations: %lu, time: %.3f s, per allocation: %.0f ns\n", 
+           depth, 
+           iterations, 
+           elapsed.count(), 
+           elapsed.count() * 1000000000.0 / iterations);
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# runs the stacktrace capturing benchmark standalone, under louse without
+# stacktraces and under louse with each of the unwinders
+# usage: bench/unwind.sh [call-depth] [iterations]
+
+DEPTH="${1:-16}"
+ITERATIONS="${2:-1000000}"
+BENCH="`dirname $0`/../out/bench-unwind"
+LIBRARY="`dirname $0`/../out/liblouse.so"
+
+echo -n "native:            "
+"$BENCH" "$DEPTH" "$ITERATIONS"
+echo -n "louse, no traces:  "
+LOUSE_WITHTRACES=no LOUSE_WITHLEAKS=no LD_PRELOAD="$LIBRARY" "$BENCH" "$DEPTH" "$ITERATIONS" 2>/dev/null | grep depth
+
+for UNWINDER in libunwind backtrace fp; do
+  printf "louse, %-11s " "$UNWINDER:"
+  LOUSE_UNWINDER="$UNWINDER" LOUSE_MAXFRAMES="$((DEPTH + 8))" LOUSE_WITHLEAKS=no LD_PRELOAD="$LIBRARY" "$BENCH" "$DEPTH" "$ITERATIONS" 2>/dev/null | grep depth
+done
+
+printf "louse, %-11s " "call sites:"
+LOUSE_CALLSITES=yes LOUSE_MAXFRAMES="$((DEPTH + 8))" LOUSE_WITHLEAKS=no LD_PRELOAD="$LIBRARY" "$BENCH" "$DEPTH" "$ITERATIONS" 2>/dev/null | grep depth
@@ -0,0 +1,294 @@
+
+#include <atomic>
+#include <mutex>
+#include <sys/mman.h>
+
+#include "Arena.h"
+
+using Arena = debugging::Arena;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                     private types
+// -----------------------------------------------------------------------------
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief header at the start of each mapped region
+////////////////////////////////////////////////////////////////////////////////
+
+  struct Mapping {
+    size_t size;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a free slab slot
+////////////////////////////////////////////////////////////////////////////////
+
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief space reserved for the mapping header. this keeps all returned
+/// memory at least 16-byte aligned
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const HeaderSize = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief size of the smallest size class
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MinClassSize = 16;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of size classes (16 bytes up to 4 KB, powers of two)
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const NumClasses = 9;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief size of the biggest size class. bigger requests get their own
+/// mapping
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MaxClassSize = MinClassSize << (NumClasses - 1);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief size of a slab
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const SlabSize = 64 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief system page size
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const PageSize = 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief minimum size of mappings that are backed by huge pages
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const HugePageSize = 2 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief per size class state, protected by the class' lock
+////////////////////////////////////////////////////////////////////////////////
+
+static std::mutex ClassLocks[NumClasses];
+
+static FreeSlot* FreeSlots[NumClasses];
+
+static char* SlabPositions[NumClasses];
+
+static char* SlabEnds[NumClasses];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief usage statistics
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> NumAllocations(0);
+
+static std::atomic<uint64_t> BytesUsed(0);
+
+static std::atomic<uint64_t> BytesMapped(0);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private helper functions
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the size class for a request size
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t SizeClass (size_t size) {
+  if (size <= MinClassSize) {
+    return 0;
+  }
+
+  // ceil(log2(size)) - log2(MinClassSize)
+  return (64 - __builtin_clzll(size - 1)) - 4;
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                       class Arena
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate memory, aligned to 16 bytes
+/// returns a nullptr if no memory is available
+////////////////////////////////////////////////////////////////////////////////
+
+void* Arena::Allocate (size_t size) {
+  if (size > MaxClassSize) {
+    size_t total = (size + HeaderSize + PageSize - 1) & ~(PageSize - 1);
+    char* base = static_cast<char*>(Map(total));
+
+    if (base == nullptr) {
+      return nullptr;
+    }
+
+    NumAllocations.fetch_add(1, std::memory_order_relaxed);
+    BytesUsed.fetch_add(total, std::memory_order_relaxed);
+
+    return static_cast<void*>(base + HeaderSize);
+  }
+
+  size_t const sizeClass = SizeClass(size);
+  size_t const classSize = MinClassSize << sizeClass;
+  void* memory;
+
+  {
+    std::lock_guard<std::mutex> locker(ClassLocks[sizeClass]);
+
+    if (FreeSlots[sizeClass] != nullptr) {
+      FreeSlot* slot = FreeSlots[sizeClass];
+      FreeSlots[sizeClass] = slot->next;
+      memory = static_cast<void*>(slot);
+    }
+    else {
+      if (SlabPositions[sizeClass] + classSize > SlabEnds[sizeClass]) {
+        char* base = static_cast<char*>(Map(SlabSize));
+
+        if (base == nullptr) {
+          return nullptr;
+        }
+
+        SlabPositions[sizeClass] = base + HeaderSize;
+        SlabEnds[sizeClass]      = base + SlabSize;
+      }
+
+      memory = static_cast<void*>(SlabPositions[sizeClass]);
+      SlabPositions[sizeClass] += classSize;
+    }
+  }
+
+  NumAllocations.fetch_add(1, std::memory_order_relaxed);
+  BytesUsed.fetch_add(classSize, std::memory_order_relaxed);
+
+  return memory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief return memory to the arena
+/// the size must be the same as the size used for allocating it. this is a
+/// no-op after Release()
+////////////////////////////////////////////////////////////////////////////////
+
+void Arena::Free (void* memory, size_t size) {
+  if (memory == nullptr || Released.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  if (size > MaxClassSize) {
+    void* base = static_cast<void*>(static_cast<char*>(memory) - HeaderSize);
+
+    NumAllocations.fetch_sub(1, std::memory_order_relaxed);
+    BytesUsed.fetch_sub(static_cast<Mapping*>(base)->size, std::memory_order_relaxed);
+
+    Unmap(base);
+    return;
+  }
+
+  size_t const sizeClass = SizeClass(size);
+
+  {
+    std::lock_guard<std::mutex> locker(ClassLocks[sizeClass]);
+
+    FreeSlot* slot = static_cast<FreeSlot*>(memory);
+    slot->next = FreeSlots[sizeClass];
+    FreeSlots[sizeClass] = slot;
+  }
+
+  NumAllocations.fetch_sub(1, std::memory_order_relaxed);
+  BytesUsed.fetch_sub(MinClassSize << sizeClass, std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief mark the arena as released
+/// the memory is not unmapped: threads that are still running may be inside
+/// louse code that checked IsReleased() just before, and must not touch 
+/// unmapped memory. the mappings go away when the process exits
+////////////////////////////////////////////////////////////////////////////////
+
+void Arena::Release () {
+  Released.store(true, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get arena usage statistics
+////////////////////////////////////////////////////////////////////////////////
+
+Arena::Statistics Arena::GetStatistics () {
+  Statistics stats;
+
+  stats.numAllocations = NumAllocations.load(std::memory_order_relaxed);
+  stats.bytesUsed      = BytesUsed.load(std::memory_order_relaxed);
+  stats.bytesMapped    = BytesMapped.load(std::memory_order_relaxed);
+
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief map a new region of memory
+////////////////////////////////////////////////////////////////////////////////
+
+void* Arena::Map (size_t size) {
+  void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+
+#ifdef MADV_HUGEPAGE
+  // big mappings are mostly hash tables, which are accessed randomly. huge
+  // pages save a lot of TLB misses for them
+  if (size >= HugePageSize) {
+    ::madvise(base, size, MADV_HUGEPAGE);
+  }
+#endif
+
+  static_cast<Mapping*>(base)->size = size;
+
+  BytesMapped.fetch_add(size, std::memory_order_relaxed);
+
+  return base;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unmap a region of memory
+////////////////////////////////////////////////////////////////////////////////
+
+void Arena::Unmap (void* base) {
+  size_t size = static_cast<Mapping*>(base)->size;
+
+  BytesMapped.fetch_sub(size, std::memory_order_relaxed);
+
+  ::munmap(base, size);
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private static variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the arena memory was released
+////////////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> Arena::Released(false);
+
@@ -0,0 +1,182 @@
+
+#ifndef LOUSE_ARENA_H
+#define LOUSE_ARENA_H 1
+
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                       class Arena
+// -----------------------------------------------------------------------------
+
+namespace debugging {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief mmap-backed allocator for louse's own metadata
+/// this keeps louse's bookkeeping out of the monitored program's heap, so it
+/// does not distort the program's fragmentation and memory usage. small
+/// requests are served from size-segregated slabs, large requests get their
+/// own mapping. the memory is never returned to the system while the
+/// process runs, as louse code may run on other threads until the very end
+////////////////////////////////////////////////////////////////////////////////
+
+  class Arena {
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                      public types
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief arena usage statistics
+////////////////////////////////////////////////////////////////////////////////
+
+      struct Statistics {
+        uint64_t numAllocations; // number of live allocations
+        uint64_t bytesUsed;      // bytes handed out, including size class slack
+        uint64_t bytesMapped;    // bytes obtained from the system
+      };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+    private:
+
+      Arena () = delete;
+
+      ~Arena () = delete;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate memory, aligned to 16 bytes
+/// returns a nullptr if no memory is available
+////////////////////////////////////////////////////////////////////////////////
+
+      static void* Allocate (size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief return memory to the arena
+/// the size must be the same as the size used for allocating it. this is a
+/// no-op after Release()
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Free (void*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief mark the arena as released, after the results were printed
+/// memory handed out before stays valid, so concurrent users are safe
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Release ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the arena memory was released
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool IsReleased () {
+        return Released.load(std::memory_order_acquire);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get arena usage statistics
+////////////////////////////////////////////////////////////////////////////////
+
+      static Statistics GetStatistics ();
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+    private:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief map a new region of memory
+////////////////////////////////////////////////////////////////////////////////
+
+      static void* Map (size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unmap a region of memory
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Unmap (void*);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private static variables
+// -----------------------------------------------------------------------------
+
+    private:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the arena memory was released
+////////////////////////////////////////////////////////////////////////////////
+
+      static std::atomic<bool> Released;
+
+  };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                              class ArenaAllocator
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief standard allocator on top of the arena
+/// containers used by louse itself must use this allocator. otherwise their
+/// nodes would be allocated via the intercepted operator new, and would be
+/// tracked like the monitored program's memory
+////////////////////////////////////////////////////////////////////////////////
+
+  template<typename T> class ArenaAllocator {
+
+    public:
+
+      typedef T value_type;
+
+      ArenaAllocator () noexcept {
+      }
+
+      template<typename U> ArenaAllocator (ArenaAllocator<U> const&) noexcept {
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate memory for n objects
+////////////////////////////////////////////////////////////////////////////////
+
+      T* allocate (size_t n) {
+        void* memory = Arena::Allocate(n * sizeof(T));
+
+        if (memory == nullptr) {
+          throw std::bad_alloc();
+        }
+
+        return static_cast<T*>(memory);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief return the memory for n objects
+////////////////////////////////////////////////////////////////////////////////
+
+      void deallocate (T* memory, size_t n) noexcept {
+        Arena::Free(memory, n * sizeof(T));
+      }
+
+      template<typename U> bool operator== (ArenaAllocator<U> const&) const noexcept {
+        return true;
+      }
+
+      template<typename U> bool operator!= (ArenaAllocator<U> const&) const noexcept {
+        return false;
+      }
+  };
+}
+
+#endif
@@ -0,0 +1,115 @@
+
+#include "Heap.h"
+#include "MemoryAllocation.h"
+#include "Tracker.h"
+
+#ifdef LOUSE_COMPACT_HEADER
+
+using BlockAddress = debugging::BlockAddress;
+using Heap = debugging::Heap;
+using MemoryAllocation = debugging::MemoryAllocation;
+using Tracker = debugging::Tracker;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                        class Heap
+// -----------------------------------------------------------------------------
+
+// this is the heap implementation for builds with compact headers. compact
+// headers have no room for list links, so the heap keeps the addresses of
+// its blocks in a striped address table. per-thread lists are not available
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a memory block to the heap
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::add (MemoryAllocation* allocation) {
+  BlockAddress entry;
+  entry.address = reinterpret_cast<uintptr_t>(allocation);
+
+  if (! blocks_.insert(entry)) {
+    Tracker::ImmediateAbort("allocation", "cannot grow heap table");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a memory block again after detach(), e.g. after resizing the
+/// block. the block is not counted as a new allocation. the total size only
+/// changes by the difference to the size the block was counted with
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::restore (MemoryAllocation* allocation, size_t counted) {
+  BlockAddress entry;
+  entry.address = reinterpret_cast<uintptr_t>(allocation);
+
+  if (! blocks_.restore(entry, counted)) {
+    Tracker::ImmediateAbort("allocation", "cannot grow heap table");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief remove a memory block from the heap
+/// blocks are always removed immediately
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::remove (MemoryAllocation* allocation) {
+  BlockAddress entry;
+  blocks_.remove(allocation, entry);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief remove a memory block from the heap, if this is possible right away
+/// this is always possible with compact headers
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::detach (MemoryAllocation* allocation) {
+  return remove(allocation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief save the current contents of the heap
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::snapshot () {
+  blocks_.snapshot();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get heap statistics
+////////////////////////////////////////////////////////////////////////////////
+
+std::pair<uint64_t, uint64_t> Heap::totals () const {
+  return blocks_.totals();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the heap saved by snapshot() is corrupted
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::isCorrupted () const {
+  bool corrupted = false;
+
+  blocks_.visit([&corrupted] (BlockAddress const& entry) -> bool {
+    corrupted = isCorrupted(reinterpret_cast<MemoryAllocation const*>(entry.address));
+    return ! corrupted;
+  });
+
+  return corrupted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not a memory block is corrupted
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::isCorrupted (MemoryAllocation const* allocation) {
+  return (! allocation->isOwnSignatureValid() &&
+          ! allocation->isOwnSignatureWiped());
+}
+
+#endif
+
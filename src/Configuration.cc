@@ -1,4 +1,5 @@
 
+#include <csignal>
 #include <cstring>
 #include <cstdlib>
 #include <string>
@@ -32,11 +33,29 @@ Configuration::Configuration () {
 
 void Configuration::fromEnvironment () {
   // set some defaults
-  suppressFilter = nullptr;
-  withLeaks      = true;
-  withTraces     = true;
-  maxFrames      = 16;
-  maxLeaks       = 100;
+  suppressFilter  = nullptr;
+  withLeaks       = true;
+  withTraces      = true;
+  withThreadHeaps = false;
+  withHeaders     = true;
+  unwinder        = UNWINDER_LIBUNWIND;
+  symbolizer      = SYMBOLIZER_ADDR2LINE;
+  symbolizeThreads = 1;
+  symbolCache     = nullptr;
+  withCallSites   = false;
+  callSiteSample  = 1000;
+  sampleBytes     = 0;
+  minSize         = 0;
+  maxSize         = 0;
+  traceModules    = nullptr;
+  recordLeaks     = nullptr;
+  retrace         = nullptr;
+  traceSequences  = nullptr;
+  trapSequences   = false;
+  toggleSignal    = 0;
+  pauseTraces     = false;
+  maxFrames       = 16;
+  maxLeaks        = 100;
 
   char const* value;
 
@@ -52,6 +71,128 @@ void Configuration::fromEnvironment () {
     withTraces = toBoolean(value, withTraces);
   }
 
+  value = ::getenv("LOUSE_THREADHEAPS");
+
+  if (value != nullptr) {
+    withThreadHeaps = toBoolean(value, withThreadHeaps);
+  }
+
+  value = ::getenv("LOUSE_WITHHEADERS");
+
+  if (value != nullptr) {
+    withHeaders = toBoolean(value, withHeaders);
+  }
+
+  value = ::getenv("LOUSE_UNWINDER");
+
+  if (value != nullptr) {
+    unwinder = toUnwinder(value, unwinder);
+  }
+
+  value = ::getenv("LOUSE_SYMBOLIZER");
+
+  if (value != nullptr) {
+    symbolizer = toSymbolizer(value, symbolizer);
+  }
+
+  value = ::getenv("LOUSE_SYMBOLIZETHREADS");
+
+  if (value != nullptr) {
+    symbolizeThreads = toNumber(value, symbolizeThreads);
+  }
+
+  if (symbolizeThreads < 1) {
+    symbolizeThreads = 1;
+  }
+  else if (symbolizeThreads > MaxSymbolizeThreads) {
+    symbolizeThreads = MaxSymbolizeThreads;
+  }
+
+  value = ::getenv("LOUSE_SYMCACHE");
+
+  if (value != nullptr && *value != '\0') {
+    symbolCache = value;
+  }
+
+  value = ::getenv("LOUSE_CALLSITES");
+
+  if (value != nullptr) {
+    withCallSites = toBoolean(value, withCallSites);
+  }
+
+  value = ::getenv("LOUSE_CALLSITESAMPLE");
+
+  if (value != nullptr) {
+    callSiteSample = toNumber(value, callSiteSample);
+  }
+
+  value = ::getenv("LOUSE_SAMPLEBYTES");
+
+  if (value != nullptr) {
+    sampleBytes = toSize(value, sampleBytes);
+  }
+
+  value = ::getenv("LOUSE_MINSIZE");
+
+  if (value != nullptr) {
+    minSize = toSize(value, minSize);
+  }
+
+  value = ::getenv("LOUSE_MAXSIZE");
+
+  if (value != nullptr) {
+    maxSize = toSize(value, maxSize);
+  }
+
+  if (hasSizeWindow()) {
+    // blocks outside the window are plain library blocks. the metadata 
+    // table tells the tracked blocks apart from these without touching 
+    // their memory, so headers cannot be used
+    withHeaders = false;
+  }
+
+  value = ::getenv("LOUSE_TRACEMODULES");
+
+  if (value != nullptr && *value != '\0') {
+    traceModules = value;
+  }
+
+  value = ::getenv("LOUSE_RECORDLEAKS");
+
+  if (value != nullptr && *value != '\0') {
+    recordLeaks = value;
+  }
+
+  value = ::getenv("LOUSE_RETRACE");
+
+  if (value != nullptr && *value != '\0') {
+    retrace = value;
+  }
+
+  value = ::getenv("LOUSE_TRACESEQ");
+
+  if (value != nullptr && *value != '\0') {
+    traceSequences = value;
+  }
+
+  value = ::getenv("LOUSE_TRAPSEQ");
+
+  if (value != nullptr) {
+    trapSequences = toBoolean(value, trapSequences);
+  }
+
+  value = ::getenv("LOUSE_TOGGLESIGNAL");
+
+  if (value != nullptr && *value != '\0') {
+    toggleSignal = toSignal(value, toggleSignal);
+  }
+
+  value = ::getenv("LOUSE_PAUSETRACES");
+
+  if (value != nullptr) {
+    pauseTraces = toBoolean(value, pauseTraces);
+  }
+
   value = ::getenv("LOUSE_FILTER");
 
   if (value != nullptr) {
@@ -116,3 +257,124 @@ int Configuration::toNumber (char const* value, int defaultValue) const {
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to an unwinder type
+////////////////////////////////////////////////////////////////////////////////
+
+Configuration::UnwinderType Configuration::toUnwinder (char const* value, UnwinderType defaultValue) const {
+  if (::strcmp(value, "libunwind") == 0) {
+    return UNWINDER_LIBUNWIND;
+  }
+
+  if (::strcmp(value, "fp") == 0) {
+    return UNWINDER_FRAMEPOINTER;
+  }
+
+  if (::strcmp(value, "backtrace") == 0) {
+    return UNWINDER_BACKTRACE;
+  }
+
+  return defaultValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a symbolizer type
+////////////////////////////////////////////////////////////////////////////////
+
+Configuration::SymbolizerType Configuration::toSymbolizer (char const* value, SymbolizerType defaultValue) const {
+  if (::strcmp(value, "builtin") == 0) {
+    return SYMBOLIZER_BUILTIN;
+  }
+
+  if (::strcmp(value, "addr2line") == 0) {
+    return SYMBOLIZER_ADDR2LINE;
+  }
+
+  return defaultValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a byte size
+/// the size may be followed by one of the suffixes k, m or g
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t Configuration::toSize (char const* value, uint64_t defaultValue) const {
+  char* end = nullptr;
+  unsigned long long v = ::strtoull(value, &end, 10);
+
+  if (end == value) {
+    return defaultValue;
+  }
+
+  switch (*end) {
+    case 'k':
+    case 'K':
+      v <<= 10;
+      ++end;
+      break;
+    case 'm':
+    case 'M':
+      v <<= 20;
+      ++end;
+      break;
+    case 'g':
+    case 'G':
+      v <<= 30;
+      ++end;
+      break;
+  }
+
+  if (*end != '\0') {
+    return defaultValue;
+  }
+
+  return static_cast<uint64_t>(v);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a signal number
+/// the signal may be given by number or by name, with or without `SIG`
+////////////////////////////////////////////////////////////////////////////////
+
+int Configuration::toSignal (char const* value, int defaultValue) const {
+  static struct {
+    char const* name;
+    int         number;
+  } const Signals[] = {
+    { "HUP",  SIGHUP },
+    { "INT",  SIGINT },
+    { "QUIT", SIGQUIT },
+    { "USR1", SIGUSR1 },
+    { "USR2", SIGUSR2 },
+    { "PIPE", SIGPIPE },
+    { "ALRM", SIGALRM },
+    { "TERM", SIGTERM },
+    { "URG",  SIGURG },
+    { "WINCH", SIGWINCH }
+  };
+
+  if (::strncmp(value, "SIG", 3) == 0) {
+    value += 3;
+  }
+
+  for (auto const& it : Signals) {
+    if (::strcmp(value, it.name) == 0) {
+      return it.number;
+    }
+  }
+
+  char* end = nullptr;
+  long v = ::strtol(value, &end, 10);
+
+  if (end == value || *end != '\0' || v < 1 || v >= NSIG) {
+    return defaultValue;
+  }
+
+  // signals that indicate program errors cannot be used
+  if (v == SIGKILL || v == SIGSTOP || v == SIGSEGV || v == SIGBUS || 
+      v == SIGILL || v == SIGFPE || v == SIGABRT || v == SIGTRAP) {
+    return defaultValue;
+  }
+
+  return static_cast<int>(v);
+}
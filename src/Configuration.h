@@ -2,6 +2,8 @@
 #ifndef LOUSE_CONFIGURATION_H
 #define LOUSE_CONFIGURATION_H 1
 
+#include <cstdint>
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                              struct Configuration
 // -----------------------------------------------------------------------------
@@ -9,6 +11,35 @@
 namespace debugging {
   struct Configuration {
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                                      public types
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief method used for capturing stack traces
+////////////////////////////////////////////////////////////////////////////////
+
+    enum UnwinderType {
+      UNWINDER_LIBUNWIND,
+      UNWINDER_FRAMEPOINTER,
+      UNWINDER_BACKTRACE
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief method used for resolving stack traces
+////////////////////////////////////////////////////////////////////////////////
+
+    enum SymbolizerType {
+      SYMBOLIZER_BUILTIN,
+      SYMBOLIZER_ADDR2LINE
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of threads used for resolving stack traces
+////////////////////////////////////////////////////////////////////////////////
+
+    static int const MaxSymbolizeThreads = 64;
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                        constructors / destructors
 // -----------------------------------------------------------------------------
@@ -33,6 +64,22 @@ namespace debugging {
 
       void fromEnvironment ();
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not only allocations within a size window are tracked
+////////////////////////////////////////////////////////////////////////////////
+
+      bool hasSizeWindow () const {
+        return (minSize > 0 || maxSize > 0);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not an allocation of the given size is tracked
+////////////////////////////////////////////////////////////////////////////////
+
+      bool isInSizeWindow (uint64_t size) const {
+        return (size >= minSize && (maxSize == 0 || size <= maxSize));
+      }
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                   private methods
 // -----------------------------------------------------------------------------
@@ -51,6 +98,32 @@ namespace debugging {
 
       int toNumber (char const*, int) const;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to an unwinder type
+////////////////////////////////////////////////////////////////////////////////
+
+      UnwinderType toUnwinder (char const*, UnwinderType) const;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a symbolizer type
+////////////////////////////////////////////////////////////////////////////////
+
+      SymbolizerType toSymbolizer (char const*, SymbolizerType) const;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a byte size
+/// the size may be followed by one of the suffixes k, m or g
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t toSize (char const*, uint64_t) const;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief convert a string argument to a signal number
+/// the signal may be given by number or by name, with or without `SIG`
+////////////////////////////////////////////////////////////////////////////////
+
+      int toSignal (char const*, int) const;
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                  public variables
 // -----------------------------------------------------------------------------
@@ -75,6 +148,124 @@ namespace debugging {
 
       bool              withTraces;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--thread-heaps`
+////////////////////////////////////////////////////////////////////////////////
+
+      bool              withThreadHeaps;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--with-headers`
+////////////////////////////////////////////////////////////////////////////////
+
+      bool              withHeaders;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--unwinder`
+////////////////////////////////////////////////////////////////////////////////
+
+      UnwinderType      unwinder;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--symbolizer`
+////////////////////////////////////////////////////////////////////////////////
+
+      SymbolizerType    symbolizer;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--symbolize-threads`
+/// 1 means that stack traces are resolved by the exiting thread only
+////////////////////////////////////////////////////////////////////////////////
+
+      int               symbolizeThreads;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--sym-cache`
+/// nullptr means that symbolized addresses are not cached on disk
+////////////////////////////////////////////////////////////////////////////////
+
+      char const*       symbolCache;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--call-sites`
+////////////////////////////////////////////////////////////////////////////////
+
+      bool              withCallSites;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--call-site-sample`
+////////////////////////////////////////////////////////////////////////////////
+
+      int               callSiteSample;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--sample-bytes`
+/// 0 means that the stack traces of all allocations are captured
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t          sampleBytes;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--min-size`
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t          minSize;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--max-size`
+/// 0 means that there is no upper limit
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t          maxSize;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--trace-modules`
+/// nullptr means that the allocations of all modules are traced
+////////////////////////////////////////////////////////////////////////////////
+
+      char const*       traceModules;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--record-leaks`
+/// nullptr means that no leak fingerprints are recorded
+////////////////////////////////////////////////////////////////////////////////
+
+      char const*       recordLeaks;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--retrace`
+/// nullptr means that the stack traces of all allocations are captured
+////////////////////////////////////////////////////////////////////////////////
+
+      char const*       retrace;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--trace-seq`
+/// a comma-separated list of allocation sequence numbers, nullptr means that
+/// the stack traces of all allocations are captured
+////////////////////////////////////////////////////////////////////////////////
+
+      char const*       traceSequences;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--trap-seq`
+////////////////////////////////////////////////////////////////////////////////
+
+      bool              trapSequences;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--toggle-signal`
+/// 0 means that stack trace capturing cannot be toggled
+////////////////////////////////////////////////////////////////////////////////
+
+      int               toggleSignal;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief configuration value `--pause-traces`
+////////////////////////////////////////////////////////////////////////////////
+
+      bool              pauseTraces;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief configuration value `--max-frames`
 ////////////////////////////////////////////////////////////////////////////////
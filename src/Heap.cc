@@ -1,20 +1,31 @@
 
+#include <new>
+
+#include "Arena.h"
 #include "Heap.h"
 #include "MemoryAllocation.h"
+#include "Tracker.h"
 
+using Arena = debugging::Arena;
 using Heap = debugging::Heap;
 using MemoryAllocation = debugging::MemoryAllocation;
+using ThreadHeap = debugging::ThreadHeap;
+using Tracker = debugging::Tracker;
 
 // -----------------------------------------------------------------------------
 // --SECTION--                                                        class Heap
 // -----------------------------------------------------------------------------
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief create the heap
 ////////////////////////////////////////////////////////////////////////////////
 
 Heap::Heap ()
-  : lock_(), head_(nullptr), numAllocations_(0), sizeAllocations_(0) {
+  : shards_(), perThread_(false), release_(nullptr), threadHeaps_(nullptr), threadHeapKey_() {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -28,31 +39,88 @@ Heap::~Heap () {
 // --SECTION--                                                    public methods
 // -----------------------------------------------------------------------------
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief switch the heap to per-thread lists
+/// this must be called before the first block is added to the heap
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::usePerThreadLists (ReleaseFuncType release) {
+  if (::pthread_key_create(&threadHeapKey_, &Heap::releaseThreadHeap) != 0) {
+    Tracker::ImmediateAbort("init", "cannot create thread heap key");
+  }
+
+  release_   = release;
+  perThread_ = true;
+}
+
+#ifndef LOUSE_COMPACT_HEADER
+
+// the list-based implementation below needs the links in the block headers.
+// builds with compact headers use the implementation in CompactHeap.cc
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief add a memory block to the heap
 ////////////////////////////////////////////////////////////////////////////////
 
 void Heap::add (MemoryAllocation* allocation) {
-  std::lock_guard<std::mutex> locker(lock_);
-
-  allocation->prev = nullptr;
-  allocation->next = head_;
+  link(allocation, true, 0);
+}
 
-  if (head_ != nullptr) {
-    head_->prev = allocation;
-  }
-  head_ = allocation;
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a memory block again after detach(), e.g. after resizing the
+/// block. the block is not counted as a new allocation. the total size only
+/// changes by the difference to the size the block was counted with
+////////////////////////////////////////////////////////////////////////////////
 
-  ++numAllocations_;
-  sizeAllocations_ += allocation->size;
+void Heap::restore (MemoryAllocation* allocation, size_t counted) {
+  link(allocation, false, counted);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief remove a memory block from the heap
+/// returns false if the block is owned by another thread and was queued
+/// for removal. the owning thread will then release the block later
 ////////////////////////////////////////////////////////////////////////////////
 
-void Heap::remove (MemoryAllocation* allocation) {
-  std::lock_guard<std::mutex> locker(lock_);
+bool Heap::remove (MemoryAllocation* allocation) {
+  if (perThread_) {
+    ThreadHeap* owner = allocation->owner;
+
+    if (owner == CurrentThreadHeap) {
+      unlink(owner, allocation);
+
+      if (owner->remoteFrees.load(std::memory_order_relaxed) != nullptr) {
+        drain(owner);
+      }
+      return true;
+    }
+
+    // block belongs to another thread. push it onto the owner's queue
+    MemoryAllocation* head = owner->remoteFrees.load(std::memory_order_relaxed);
+
+    do {
+      allocation->remoteNext = head;
+    }
+    while (! owner->remoteFrees.compare_exchange_weak(head, allocation, std::memory_order_release, std::memory_order_relaxed));
+
+    // if the owning thread has exited, nobody would drain the queue until
+    // the heap is adopted by a new thread. so drain it ourselves
+    bool expected = false;
+    if (owner->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      drain(owner);
+      owner->owned.store(false, std::memory_order_release);
+    }
+
+    return false;
+  }
+
+  Shard& s = shard(allocation);
+
+  std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+  if (mustLock()) {
+    locker.lock();
+  }
 
   if (allocation->prev != nullptr) {
     allocation->prev->next = allocation->next;
@@ -62,9 +130,103 @@ void Heap::remove (MemoryAllocation* allocation) {
     allocation->next->prev = allocation->prev;
   }
 
-  if (head_ == allocation) {
-    head_ = allocation->next;
+  if (s.head == allocation) {
+    s.head = allocation->next;
   }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief remove a memory block from the heap, if this is possible right away
+/// returns false for blocks owned by another thread. they are left in the
+/// heap untouched
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::detach (MemoryAllocation* allocation) {
+  if (perThread_ && allocation->owner != CurrentThreadHeap) {
+    return false;
+  }
+
+  return remove(allocation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief save the current heads of all lists
+/// this will also drain all pending remote frees of the current thread and of
+/// exited threads. queues of other running threads cannot be drained safely
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::snapshot () {
+  for (size_t i = 0; i < NumShards; ++i) {
+    std::lock_guard<std::mutex> locker(shards_[i].lock);
+    shards_[i].snapshot = shards_[i].head;
+  }
+
+  auto heap = threadHeaps_.load(std::memory_order_acquire);
+
+  while (heap != nullptr) {
+    if (heap == CurrentThreadHeap) {
+      drain(heap);
+    }
+    else {
+      bool expected = false;
+      if (heap->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        drain(heap);
+        heap->owned.store(false, std::memory_order_release);
+      }
+    }
+
+    heap->snapshot = heap->head;
+    heap = heap->nextHeap;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get heap statistics
+////////////////////////////////////////////////////////////////////////////////
+
+std::pair<uint64_t, uint64_t> Heap::totals () const {
+  uint64_t numAllocations  = 0;
+  uint64_t sizeAllocations = 0;
+
+  for (size_t i = 0; i < NumShards; ++i) {
+    numAllocations  += shards_[i].numAllocations;
+    sizeAllocations += shards_[i].sizeAllocations;
+  }
+
+  auto heap = threadHeaps_.load(std::memory_order_acquire);
+
+  while (heap != nullptr) {
+    numAllocations  += heap->numAllocations;
+    sizeAllocations += heap->sizeAllocations;
+    heap = heap->nextHeap;
+  }
+
+  return std::make_pair(numAllocations, sizeAllocations); 
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the heap saved by snapshot() is corrupted
+////////////////////////////////////////////////////////////////////////////////
+
+bool Heap::isCorrupted () const {
+  for (size_t i = 0; i < NumShards; ++i) {
+    if (isCorrupted(shards_[i].snapshot)) {
+      return true;
+    }
+  }
+
+  auto heap = threadHeaps_.load(std::memory_order_acquire);
+
+  while (heap != nullptr) {
+    if (isCorrupted(heap->snapshot)) {
+      return true;
+    }
+    heap = heap->nextHeap;
+  }
+
+  return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -75,7 +237,8 @@ bool Heap::isCorrupted (MemoryAllocation const* start) {
   auto allocation = start;
 
   while (allocation != nullptr) {
-    if (! allocation->isOwnSignatureValid()) {
+    if (! allocation->isOwnSignatureValid() && 
+        ! allocation->isOwnSignatureWiped()) {
       return true;
     }
 
@@ -85,3 +248,192 @@ bool Heap::isCorrupted (MemoryAllocation const* start) {
   return false;
 }
 
+#endif
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+#ifndef LOUSE_COMPACT_HEADER
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief link a memory block into the list of the current thread or of its
+/// shard. the block is counted as a new allocation if requested, and its
+/// size is added to the total, minus the size it was counted with before
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::link (MemoryAllocation* allocation, bool count, size_t counted) {
+  if (perThread_) {
+    ThreadHeap* heap = threadHeap();
+
+    if (heap->remoteFrees.load(std::memory_order_relaxed) != nullptr) {
+      drain(heap);
+    }
+
+    allocation->owner = heap;
+    allocation->prev  = nullptr;
+    allocation->next  = heap->head;
+
+    if (heap->head != nullptr) {
+      heap->head->prev = allocation;
+    }
+    heap->head = allocation;
+
+    if (count) {
+      ++heap->numAllocations;
+    }
+    heap->sizeAllocations += allocation->size - counted;
+    return;
+  }
+
+  Shard& s = shard(allocation);
+
+  std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+  if (mustLock()) {
+    locker.lock();
+  }
+
+  allocation->prev = nullptr;
+  allocation->next = s.head;
+
+  if (s.head != nullptr) {
+    s.head->prev = allocation;
+  }
+  s.head = allocation;
+
+  if (count) {
+    ++s.numAllocations;
+  }
+
+  // a moved block may end up in another shard than it was counted in. the
+  // shard totals are only ever summed up, so a wrap-around cancels out
+  s.sizeAllocations += allocation->size - counted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the shard responsible for a memory block
+/// blocks are at least 16-byte aligned, so the lower bits of the address are
+/// dropped before hashing
+////////////////////////////////////////////////////////////////////////////////
+
+Heap::Shard& Heap::shard (MemoryAllocation const* allocation) {
+  uint64_t hash = (reinterpret_cast<uintptr_t>(allocation) >> 4) * 0x9e3779b97f4a7c15ULL;
+
+  return shards_[(hash >> 32) % NumShards];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the heap of the current thread, creating or adopting one
+////////////////////////////////////////////////////////////////////////////////
+
+ThreadHeap* Heap::threadHeap () {
+  ThreadHeap* heap = CurrentThreadHeap;
+
+  if (heap != nullptr) {
+    return heap;
+  }
+
+  // try to adopt the heap of an exited thread first
+  heap = threadHeaps_.load(std::memory_order_acquire);
+
+  while (heap != nullptr) {
+    bool expected = false;
+    if (heap->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      break;
+    }
+    heap = heap->nextHeap;
+  }
+
+  if (heap == nullptr) {
+    void* memory = Arena::Allocate(sizeof(ThreadHeap));
+
+    if (memory == nullptr) {
+      Tracker::ImmediateAbort("allocation", "cannot allocate thread heap");
+    }
+
+    heap = new (memory) ThreadHeap();
+    heap->nextHeap = threadHeaps_.load(std::memory_order_relaxed);
+
+    while (! threadHeaps_.compare_exchange_weak(heap->nextHeap, heap, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+  }
+
+  CurrentThreadHeap = heap;
+  ::pthread_setspecific(threadHeapKey_, heap);
+
+  return heap;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unlink and release all blocks queued by other threads
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::drain (ThreadHeap* heap) {
+  MemoryAllocation* allocation = heap->remoteFrees.exchange(nullptr, std::memory_order_acquire);
+
+  while (allocation != nullptr) {
+    MemoryAllocation* next = allocation->remoteNext;
+
+    unlink(heap, allocation);
+    release_(allocation);
+
+    allocation = next;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unlink a memory block from a thread heap
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::unlink (ThreadHeap* heap, MemoryAllocation* allocation) {
+  if (allocation->prev != nullptr) {
+    allocation->prev->next = allocation->next;
+  }
+
+  if (allocation->next != nullptr) {
+    allocation->next->prev = allocation->prev;
+  }
+
+  if (heap->head == allocation) {
+    heap->head = allocation->next;
+  }
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief release the current thread's heap on thread exit
+/// the heap keeps its blocks, and will be adopted by another thread later
+////////////////////////////////////////////////////////////////////////////////
+
+void Heap::releaseThreadHeap (void* data) {
+  auto heap = static_cast<ThreadHeap*>(data);
+
+  if (heap == CurrentThreadHeap) {
+    CurrentThreadHeap = nullptr;
+  }
+
+  heap->owned.store(false, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                           public static variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the process has started additional threads
+////////////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> Heap::MultiThreaded(false);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private static variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief heap of the current thread
+////////////////////////////////////////////////////////////////////////////////
+
+__thread ThreadHeap* Heap::CurrentThreadHeap = nullptr;
+
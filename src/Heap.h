@@ -4,22 +4,93 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
+#include <atomic>
 #include <mutex>
 #include <utility>
+#include <pthread.h>
+
+#include "MemoryAllocation.h"
+#include "MetadataTable.h"
 
 // -----------------------------------------------------------------------------
-// --SECTION--                                                        class Heap
+// --SECTION--                                                 struct ThreadHeap
 // -----------------------------------------------------------------------------
 
 namespace debugging {
-  struct MemoryAllocation;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a per-thread list of memory blocks
+/// the list is only modified by the owning thread, so it does not need a
+/// lock. blocks freed by other threads are pushed onto the lock-free
+/// remoteFrees stack, which is drained by the owning thread. thread heaps
+/// are never destroyed: when a thread exits, its heap is released and can
+/// be adopted by the next thread that starts
+////////////////////////////////////////////////////////////////////////////////
+
+  struct ThreadHeap {
+    ThreadHeap ()
+      : head(nullptr), snapshot(nullptr), numAllocations(0), sizeAllocations(0),
+        remoteFrees(nullptr), owned(true), nextHeap(nullptr) {
+    }
+
+    MemoryAllocation*              head;
+    MemoryAllocation*              snapshot;
+    uint64_t                       numAllocations;
+    uint64_t                       sizeAllocations;
+    std::atomic<MemoryAllocation*> remoteFrees;
+    std::atomic<bool>              owned;
+    ThreadHeap*                    nextHeap;
+  };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                        class Heap
+// -----------------------------------------------------------------------------
 
   class Heap {
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                                      public types
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of heap shards
+/// memory blocks are distributed over the shards by their address, so
+/// concurrent add() and remove() calls will mostly not contend for the
+/// same lock
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t const NumShards = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a heap shard, with its own linked list, lock and statistics
+/// shards are cache-line aligned to avoid false sharing between them
+////////////////////////////////////////////////////////////////////////////////
+
+      struct alignas(64) Shard {
+        Shard ()
+          : lock(), head(nullptr), snapshot(nullptr), numAllocations(0), sizeAllocations(0) {
+        }
+
+        std::mutex        lock;
+        MemoryAllocation* head;
+        MemoryAllocation* snapshot;
+        uint64_t          numAllocations;
+        uint64_t          sizeAllocations;
+      };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief function that finally releases a memory block
+////////////////////////////////////////////////////////////////////////////////
+
+      typedef void (*ReleaseFuncType) (MemoryAllocation*);
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                        constructors / destructors
 // -----------------------------------------------------------------------------
-    
+
     public:
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -40,41 +111,89 @@ namespace debugging {
 
     public:
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief switch the heap to per-thread lists
+/// this must be called before the first block is added to the heap
+////////////////////////////////////////////////////////////////////////////////
+
+      void usePerThreadLists (ReleaseFuncType);
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief add a memory block to the heap
 ////////////////////////////////////////////////////////////////////////////////
 
       void add (MemoryAllocation*);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a memory block again after detach(), e.g. after resizing the
+/// block. the block is not counted as a new allocation. the total size only
+/// changes by the difference to the size the block was counted with
+////////////////////////////////////////////////////////////////////////////////
+
+      void restore (MemoryAllocation*, size_t);
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief remove a memory block from the heap
+/// returns false if the block is owned by another thread and was queued
+/// for removal. the owning thread will then release the block later
 ////////////////////////////////////////////////////////////////////////////////
 
-      void remove (MemoryAllocation*);
+      bool remove (MemoryAllocation*);
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief get the first memory block in the heap
+/// @brief remove a memory block from the heap, if this is possible right away
+/// returns false for blocks owned by another thread. they are left in the
+/// heap untouched
+////////////////////////////////////////////////////////////////////////////////
+
+      bool detach (MemoryAllocation*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief save the current heads of all lists
+/// this will also drain all pending remote frees
+////////////////////////////////////////////////////////////////////////////////
+
+      void snapshot ();
+
 ////////////////////////////////////////////////////////////////////////////////
-  
-      MemoryAllocation* begin () const {
-        return head_;
+/// @brief call the visitor for all memory blocks saved by snapshot()
+/// iteration stops when the visitor returns false
+////////////////////////////////////////////////////////////////////////////////
+
+      template<typename T> void visit (T const& visitor) const {
+#ifdef LOUSE_COMPACT_HEADER
+        blocks_.visit([&visitor] (BlockAddress const& entry) -> bool {
+          return visitor(reinterpret_cast<MemoryAllocation const*>(entry.address));
+        });
+#else
+        for (size_t i = 0; i < NumShards; ++i) {
+          if (! visitList(shards_[i].snapshot, visitor)) {
+            return;
+          }
+        }
+
+        auto heap = threadHeaps_.load(std::memory_order_acquire);
+
+        while (heap != nullptr) {
+          if (! visitList(heap->snapshot, visitor)) {
+            return;
+          }
+          heap = heap->nextHeap;
+        }
+#endif
       }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief get heap statistics
 ////////////////////////////////////////////////////////////////////////////////
 
-      std::pair<uint64_t, uint64_t> totals () const {
-        return std::make_pair(numAllocations_, sizeAllocations_); 
-      }
+      std::pair<uint64_t, uint64_t> totals () const;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief whether or not the heap is corrupted
+/// @brief whether or not the heap saved by snapshot() is corrupted
 ////////////////////////////////////////////////////////////////////////////////
 
-      bool isCorrupted () const {
-        return isCorrupted(head_);
-      }
+      bool isCorrupted () const;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief whether or not the heap is corrupted
@@ -82,35 +201,151 @@ namespace debugging {
 
       static bool isCorrupted (MemoryAllocation const*);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not locks must be acquired
+/// this is false as long as the process is single-threaded. the flag only
+/// changes before the first additional thread starts, so a relaxed load 
+/// suffices: the new thread observes the store via pthread_create()
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool mustLock () {
+        return MultiThreaded.load(std::memory_order_relaxed);
+      }
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+    private:
+
+#ifndef LOUSE_COMPACT_HEADER
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief link a memory block into the list of the current thread or of its
+/// shard. the block is counted as a new allocation if requested, and its
+/// size is added to the total, minus the size it was counted with before
+////////////////////////////////////////////////////////////////////////////////
+
+      void link (MemoryAllocation*, bool, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief call the visitor for all memory blocks in a list
+////////////////////////////////////////////////////////////////////////////////
+
+      template<typename T> static bool visitList (MemoryAllocation const* allocation,
+                                                  T const& visitor) {
+        while (allocation != nullptr) {
+          if (! visitor(allocation)) {
+            return false;
+          }
+          allocation = allocation->next;
+        }
+        return true;
+      }
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the shard responsible for a memory block
+////////////////////////////////////////////////////////////////////////////////
+
+      Shard& shard (MemoryAllocation const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the heap of the current thread, creating or adopting one
+////////////////////////////////////////////////////////////////////////////////
+
+      ThreadHeap* threadHeap ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unlink and release all blocks queued by other threads
+////////////////////////////////////////////////////////////////////////////////
+
+      void drain (ThreadHeap*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unlink a memory block from a thread heap
+////////////////////////////////////////////////////////////////////////////////
+
+      static void unlink (ThreadHeap*, MemoryAllocation*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief release the current thread's heap on thread exit
+////////////////////////////////////////////////////////////////////////////////
+
+      static void releaseThreadHeap (void*);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                           public static variables
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the process has started additional threads
+/// as long as this is false, the shards are modified without locking. it
+/// is set by the pthread_create() wrapper before the first thread starts.
+/// threads started without going through pthread_create(), e.g. via a raw
+/// clone(), are not supported
+////////////////////////////////////////////////////////////////////////////////
+
+      static std::atomic<bool> MultiThreaded;
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                 private variables
 // -----------------------------------------------------------------------------
-      
+
     private:
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief mutex that protects the heap's linked list
+/// @brief the heap shards
+/// each shard's counters contain the total number and size of allocations
+/// made in the shard (ever increasing)
 ////////////////////////////////////////////////////////////////////////////////
 
-      std::mutex lock_;
+      Shard shards_[NumShards];
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief first memory block on the heap
+/// @brief whether or not per-thread lists are used instead of the shards
 ////////////////////////////////////////////////////////////////////////////////
 
-      MemoryAllocation* head_;
+      bool perThread_;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief total number of allocations made (ever increasing)
+/// @brief function for releasing blocks freed by other threads
 ////////////////////////////////////////////////////////////////////////////////
 
-      uint64_t numAllocations_;
+      ReleaseFuncType release_;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief all thread heaps ever created
+////////////////////////////////////////////////////////////////////////////////
+
+      std::atomic<ThreadHeap*> threadHeaps_;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief key for detecting thread exit
+////////////////////////////////////////////////////////////////////////////////
+
+      pthread_key_t threadHeapKey_;
+
+#ifdef LOUSE_COMPACT_HEADER
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief addresses of all blocks on the heap
+/// compact headers have no list links, so the blocks are kept in an address
+/// table instead of the shards and thread heaps
+////////////////////////////////////////////////////////////////////////////////
+
+      MetadataTable<BlockAddress> blocks_;
+
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief total size of allocations made (ever increasing)
+/// @brief heap of the current thread
 ////////////////////////////////////////////////////////////////////////////////
 
-      uint64_t sizeAllocations_;
+      static __thread ThreadHeap* CurrentThreadHeap __attribute__ ((tls_model("initial-exec")));
 
   };
 }
@@ -18,13 +18,18 @@ using MemoryAllocation = debugging::MemoryAllocation;
 
 void MemoryAllocation::init (size_t size, MemoryAllocation::AccessType type) {
   this->size         = size;
-  this->stack        = nullptr;
+  this->stack        = 0;
   this->ownSignature = MemoryAllocation::ValidSignature;
   this->type         = type;
+  this->alignShift   = 0;
+  setSequence(0);
+#ifndef LOUSE_COMPACT_HEADER
   this->prev         = nullptr;
   this->next         = nullptr;
+  this->owner        = nullptr;
+#endif
 
-  ::memcpy(tailSignatureAddress(), &TailSignature, sizeof(TailSignature));
+  SetTailSignature(memory(), size);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,13 +38,21 @@ void MemoryAllocation::init (size_t size, MemoryAllocation::AccessType type) {
 
 char const* MemoryAllocation::AccessTypeName (MemoryAllocation::AccessType type) {
   switch (type) {
-    case MemoryAllocation::TYPE_NEW:          return "new";
-    case MemoryAllocation::TYPE_NEW_ARRAY:    return "new[]";
-    case MemoryAllocation::TYPE_MALLOC:       return "malloc()";
-    case MemoryAllocation::TYPE_DELETE:       return "delete";
-    case MemoryAllocation::TYPE_DELETE_ARRAY: return "delete[]";
-    case MemoryAllocation::TYPE_FREE:         return "free()";
-    default:                return "invalid"; 
+    case MemoryAllocation::TYPE_NEW:                         return "new";
+    case MemoryAllocation::TYPE_NEW_ARRAY:                   return "new[]";
+    case MemoryAllocation::TYPE_MALLOC:                      return "malloc()";
+    case MemoryAllocation::TYPE_DELETE:                      return "delete";
+    case MemoryAllocation::TYPE_DELETE_ARRAY:                return "delete[]";
+    case MemoryAllocation::TYPE_FREE:                        return "free()";
+    case MemoryAllocation::TYPE_NEW_ALIGNED:                 return "new(align_val_t)";
+    case MemoryAllocation::TYPE_NEW_ARRAY_ALIGNED:           return "new[](align_val_t)";
+    case MemoryAllocation::TYPE_DELETE_SIZED:                return "delete(size_t)";
+    case MemoryAllocation::TYPE_DELETE_ARRAY_SIZED:          return "delete[](size_t)";
+    case MemoryAllocation::TYPE_DELETE_ALIGNED:              return "delete(align_val_t)";
+    case MemoryAllocation::TYPE_DELETE_ARRAY_ALIGNED:        return "delete[](align_val_t)";
+    case MemoryAllocation::TYPE_DELETE_SIZED_ALIGNED:        return "delete(size_t, align_val_t)";
+    case MemoryAllocation::TYPE_DELETE_ARRAY_SIZED_ALIGNED:  return "delete[](size_t, align_val_t)";
+    default:                                                 return "invalid";
   }
 }
 
@@ -49,10 +62,27 @@ char const* MemoryAllocation::AccessTypeName (MemoryAllocation::AccessType type)
 
 MemoryAllocation::AccessType MemoryAllocation::MatchingFreeType (MemoryAllocation::AccessType type) {
   switch (type) {
-    case MemoryAllocation::TYPE_NEW:          return MemoryAllocation::TYPE_DELETE;
-    case MemoryAllocation::TYPE_NEW_ARRAY:    return MemoryAllocation::TYPE_DELETE_ARRAY;
-    case MemoryAllocation::TYPE_MALLOC:       return MemoryAllocation::TYPE_FREE;
-    default:                                  return MemoryAllocation::TYPE_INVALID;
+    case MemoryAllocation::TYPE_NEW:                         return MemoryAllocation::TYPE_DELETE;
+    case MemoryAllocation::TYPE_NEW_ARRAY:                   return MemoryAllocation::TYPE_DELETE_ARRAY;
+    case MemoryAllocation::TYPE_MALLOC:                      return MemoryAllocation::TYPE_FREE;
+    case MemoryAllocation::TYPE_NEW_ALIGNED:                 return MemoryAllocation::TYPE_DELETE_ALIGNED;
+    case MemoryAllocation::TYPE_NEW_ARRAY_ALIGNED:           return MemoryAllocation::TYPE_DELETE_ARRAY_ALIGNED;
+    default:                                                 return MemoryAllocation::TYPE_INVALID;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the deallocation method without the size argument for a sized
+/// deallocation method
+////////////////////////////////////////////////////////////////////////////////
+
+MemoryAllocation::AccessType MemoryAllocation::UnsizedFreeType (MemoryAllocation::AccessType type) {
+  switch (type) {
+    case MemoryAllocation::TYPE_DELETE_SIZED:                return MemoryAllocation::TYPE_DELETE;
+    case MemoryAllocation::TYPE_DELETE_ARRAY_SIZED:          return MemoryAllocation::TYPE_DELETE_ARRAY;
+    case MemoryAllocation::TYPE_DELETE_SIZED_ALIGNED:        return MemoryAllocation::TYPE_DELETE_ALIGNED;
+    case MemoryAllocation::TYPE_DELETE_ARRAY_SIZED_ALIGNED:  return MemoryAllocation::TYPE_DELETE_ARRAY_ALIGNED;
+    default:                                                 return type;
   }
 }
 
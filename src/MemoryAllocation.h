@@ -7,6 +7,7 @@
 #include <cstring>
 
 namespace debugging {
+  struct ThreadHeap;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief helper function for rounding up to next multiple of 16
@@ -33,7 +34,15 @@ namespace debugging {
       TYPE_MALLOC,
       TYPE_DELETE,
       TYPE_DELETE_ARRAY,
-      TYPE_FREE
+      TYPE_FREE,
+      TYPE_NEW_ALIGNED,
+      TYPE_NEW_ARRAY_ALIGNED,
+      TYPE_DELETE_SIZED,
+      TYPE_DELETE_ARRAY_SIZED,
+      TYPE_DELETE_ALIGNED,
+      TYPE_DELETE_ARRAY_ALIGNED,
+      TYPE_DELETE_SIZED_ALIGNED,
+      TYPE_DELETE_ARRAY_SIZED_ALIGNED
     };
 
 // -----------------------------------------------------------------------------
@@ -95,6 +104,45 @@ namespace debugging {
         return static_cast<void const*>(reinterpret_cast<char const*>(this) + OwnSize());
       }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the start address of the block as returned by the library
+/// for aligned blocks, the header is not at the start of the block
+////////////////////////////////////////////////////////////////////////////////
+
+      void* base () {
+        if (alignShift == 0) {
+          return static_cast<void*>(this);
+        }
+
+        size_t const padding = HeaderSpace(static_cast<size_t>(1) << alignShift) - OwnSize();
+        return static_cast<void*>(reinterpret_cast<char*>(this) - padding);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the allocation's sequence number
+/// compact headers have no room for it, so this is always 0 with them
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t sequence () const {
+#ifdef LOUSE_COMPACT_HEADER
+        return 0;
+#else
+        return sequenceNumber;
+#endif
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief set the allocation's sequence number
+////////////////////////////////////////////////////////////////////////////////
+
+      void setSequence (uint64_t value) {
+#ifdef LOUSE_COMPACT_HEADER
+        (void) value;
+#else
+        sequenceNumber = value;
+#endif
+      }
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief get the address of the block's tail signature
 ////////////////////////////////////////////////////////////////////////////////
@@ -127,12 +175,22 @@ namespace debugging {
         return ownSignature == ValidSignature;
       }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the memory block's own signature was wiped
+/// this is the case for blocks that were freed but are still queued for
+/// removal from another thread's heap
+////////////////////////////////////////////////////////////////////////////////
+
+      bool isOwnSignatureWiped () const {
+        return ownSignature == InvalidSignature;
+      }
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief whether or not the memory block's tail signature is valid
 ////////////////////////////////////////////////////////////////////////////////
 
       bool isTailSignatureValid () const {
-        return (::memcmp(tailSignatureAddress(), &TailSignature, sizeof(TailSignature)) == 0);
+        return IsTailSignatureValid(memory(), size);
       }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -143,13 +201,51 @@ namespace debugging {
         return roundup(sizeof(MemoryAllocation));
       }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief return the space needed in front of the user memory of a block
+/// with the given alignment. this is the own size rounded up to a multiple 
+/// of the alignment, so the header ends right at an aligned address
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t HeaderSpace (size_t alignment) {
+        if (alignment <= 16) {
+          return OwnSize();
+        }
+        return (OwnSize() + alignment - 1) & ~(alignment - 1);
+      }
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief return the total overhead (own size + tail signature size) of a
 /// memory block
 ////////////////////////////////////////////////////////////////////////////////
 
       static size_t TotalSize () {
-        return OwnSize() + sizeof(TailSignature);
+        return OwnSize() + TailSize();
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief return the size of the tail signature
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t TailSize () {
+        return sizeof(TailSignature);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief write the tail signature after the user memory of a block
+////////////////////////////////////////////////////////////////////////////////
+
+      static void SetTailSignature (void* memory, size_t size) {
+        ::memcpy(static_cast<char*>(memory) + size, &TailSignature, sizeof(TailSignature));
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the tail signature after the user memory of a 
+/// block is valid
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool IsTailSignatureValid (void const* memory, size_t size) {
+        return (::memcmp(static_cast<char const*>(memory) + size, &TailSignature, sizeof(TailSignature)) == 0);
       }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -164,29 +260,56 @@ namespace debugging {
 
       static AccessType MatchingFreeType (AccessType);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the deallocation method without the size argument for a sized
+/// deallocation method. memory may be freed with or without its size, so 
+/// the result is what MatchingFreeType() is compared with
+////////////////////////////////////////////////////////////////////////////////
+
+      static AccessType UnsizedFreeType (AccessType);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not a deallocation method is passed the block's size
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool IsSizedFreeType (AccessType type) {
+        return (UnsizedFreeType(type) != type);
+      }
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                  public variables
 // -----------------------------------------------------------------------------
 
     public:
 
+#ifdef LOUSE_COMPACT_HEADER
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief size of memory allocated by the user
+/// compact headers pack size and type into a single word, and have no list
+/// links. the heap keeps track of the blocks in an address table instead
 ////////////////////////////////////////////////////////////////////////////////
 
-      size_t            size;
+      uint64_t          size : 48;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief stacktrace of the allocation site
+/// @brief method used for allocating memory 
 ////////////////////////////////////////////////////////////////////////////////
 
-      void**            stack;
+      AccessType        type : 8;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief method used for allocating memory 
+/// @brief log2 of the block's alignment, 0 for blocks from malloc()
 ////////////////////////////////////////////////////////////////////////////////
 
-      AccessType        type;
+      uint64_t          alignShift : 8;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief id of the allocation site's stacktrace in the stack depot
+/// 0 means no stacktrace is available
+////////////////////////////////////////////////////////////////////////////////
+
+      uint32_t          stack;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief own signature of memory block
@@ -195,6 +318,46 @@ namespace debugging {
 
       uint32_t          ownSignature;
 
+#else
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief size of memory allocated by the user
+////////////////////////////////////////////////////////////////////////////////
+
+      size_t            size;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief id of the allocation site's stacktrace in the stack depot
+/// 0 means no stacktrace is available
+////////////////////////////////////////////////////////////////////////////////
+
+      uint32_t          stack;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief own signature of memory block
+/// this is set on allocation and wiped on deallocation
+////////////////////////////////////////////////////////////////////////////////
+
+      uint32_t          ownSignature;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief method used for allocating memory 
+////////////////////////////////////////////////////////////////////////////////
+
+      AccessType        type : 8;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief log2 of the block's alignment, 0 for blocks from malloc()
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t          alignShift : 8;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sequence number of the allocation, 0 if none was assigned
+////////////////////////////////////////////////////////////////////////////////
+
+      uint64_t          sequenceNumber : 48;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief previous memory block (linked list used by heap)
 ////////////////////////////////////////////////////////////////////////////////
@@ -207,6 +370,19 @@ namespace debugging {
 
       MemoryAllocation* next;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief owning thread heap (only used with per-thread lists)
+/// when the block is freed by another thread, this is reused as the link 
+/// in the owner's queue of remote frees
+////////////////////////////////////////////////////////////////////////////////
+
+      union {
+        ThreadHeap*       owner;
+        MemoryAllocation* remoteNext;
+      };
+
+#endif
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                          private static variables
 // -----------------------------------------------------------------------------
@@ -232,6 +408,12 @@ namespace debugging {
       static const uint32_t TailSignature;
 
   };
+
+#ifdef LOUSE_COMPACT_HEADER
+  static_assert(sizeof(MemoryAllocation) == 16, "unexpected compact header size");
+#else
+  static_assert(sizeof(MemoryAllocation) == 48, "unexpected header size");
+#endif
 }
 
 #endif
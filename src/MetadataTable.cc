@@ -0,0 +1,314 @@
+
+#include <cstring>
+
+#include "Arena.h"
+#include "Heap.h"
+#include "MetadataTable.h"
+
+using Arena         = debugging::Arena;
+using Heap          = debugging::Heap;
+using BlockAddress  = debugging::BlockAddress;
+using BlockMetadata = debugging::BlockMetadata;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief initial number of slots in a stripe
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const InitialCapacity = 1024;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                               class MetadataTable
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief create the table
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> debugging::MetadataTable<T>::MetadataTable ()
+  : stripes_() {
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief destroy the table
+/// the table's memory is released together with the arena
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> debugging::MetadataTable<T>::~MetadataTable () {
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block
+/// returns false if the table cannot grow
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::insert (Entry const& entry) {
+  return store(entry, true, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block again after remove(), e.g. after
+/// resizing the block. the block is not counted as a new allocation. the
+/// total size only changes by the difference to the size the block was
+/// counted with. returns false if the table cannot grow
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::restore (Entry const& entry, size_t counted) {
+  return store(entry, false, counted);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief remove the entry for a memory block, and return it
+/// returns false if the address is not in the table
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::remove (void const* pointer, Entry& entry) {
+  uintptr_t const address = reinterpret_cast<uintptr_t>(pointer);
+  Stripe& s = stripe(address);
+
+  std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+  if (Heap::mustLock()) {
+    locker.lock();
+  }
+
+  size_t slot = find(s, address);
+
+  if (slot == s.capacity) {
+    return false;
+  }
+
+  entry = s.entries[slot];
+
+  // backward-shift deletion: move following entries of the probe sequence
+  // into the hole, so lookups never need tombstones
+  size_t const mask = s.capacity - 1;
+  size_t next = (slot + 1) & mask;
+
+  while (s.entries[next].address != 0) {
+    size_t home = hash(s.entries[next].address) & mask;
+
+    bool const inRange = (slot <= next) ? (slot < home && home <= next)
+                                        : (slot < home || home <= next);
+
+    if (! inRange) {
+      s.entries[slot] = s.entries[next];
+      slot = next;
+    }
+
+    next = (next + 1) & mask;
+  }
+
+  s.entries[slot].address = 0;
+  --s.used;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief look up the entry for a memory block
+/// returns false if the address is not in the table
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::lookup (void const* pointer, Entry& entry) const {
+  uintptr_t const address = reinterpret_cast<uintptr_t>(pointer);
+  Stripe const& s = stripe(address);
+
+  std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+  if (Heap::mustLock()) {
+    locker.lock();
+  }
+
+  size_t slot = find(s, address);
+
+  if (slot == s.capacity) {
+    return false;
+  }
+
+  entry = s.entries[slot];
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief copy all current entries
+/// the copy is used by visit(), so it can run without holding any lock
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> void debugging::MetadataTable<T>::snapshot () {
+  for (size_t i = 0; i < NumStripes; ++i) {
+    Stripe& s = stripes_[i];
+
+    std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+    if (Heap::mustLock()) {
+      locker.lock();
+    }
+
+    if (s.snapshot != nullptr) {
+      Arena::Free(s.snapshot, s.snapshotSize * sizeof(Entry));
+      s.snapshot     = nullptr;
+      s.snapshotSize = 0;
+    }
+
+    if (s.used == 0) {
+      continue;
+    }
+
+    s.snapshot = static_cast<Entry*>(Arena::Allocate(s.used * sizeof(Entry)));
+
+    if (s.snapshot == nullptr) {
+      continue;
+    }
+
+    for (size_t j = 0; j < s.capacity; ++j) {
+      if (s.entries[j].address != 0) {
+        s.snapshot[s.snapshotSize++] = s.entries[j];
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get table statistics
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> std::pair<uint64_t, uint64_t> debugging::MetadataTable<T>::totals () const {
+  uint64_t numAllocations  = 0;
+  uint64_t sizeAllocations = 0;
+
+  for (size_t i = 0; i < NumStripes; ++i) {
+    numAllocations  += stripes_[i].numAllocations;
+    sizeAllocations += stripes_[i].sizeAllocations;
+  }
+
+  return std::make_pair(numAllocations, sizeAllocations);
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block, and optionally count it as a
+/// new allocation
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::store (Entry const& entry, bool count, size_t counted) {
+  Stripe& s = stripe(entry.address);
+
+  std::unique_lock<std::mutex> locker(s.lock, std::defer_lock);
+
+  if (Heap::mustLock()) {
+    locker.lock();
+  }
+
+  // keep the load factor below 3/4
+  if ((s.used + 1) * 4 > s.capacity * 3) {
+    if (! grow(s)) {
+      return false;
+    }
+  }
+
+  size_t const mask = s.capacity - 1;
+  size_t slot = hash(entry.address) & mask;
+
+  while (s.entries[slot].address != 0) {
+    slot = (slot + 1) & mask;
+  }
+
+  s.entries[slot] = entry;
+  ++s.used;
+
+  if (count) {
+    ++s.numAllocations;
+  }
+
+  // a moved block may end up in another stripe than it was counted in. the
+  // stripe totals are only ever summed up, so a wrap-around cancels out
+  s.sizeAllocations += entry.blockSize() - counted;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief find the slot of an address in a stripe
+/// returns the stripe's capacity if the address is not in the stripe
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> size_t debugging::MetadataTable<T>::find (Stripe const& s, uintptr_t address) {
+  if (s.capacity == 0 || address == 0) {
+    return s.capacity;
+  }
+
+  size_t const mask = s.capacity - 1;
+  size_t slot = hash(address) & mask;
+
+  while (s.entries[slot].address != 0) {
+    if (s.entries[slot].address == address) {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  return s.capacity;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief double the capacity of a stripe
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename T> bool debugging::MetadataTable<T>::grow (Stripe& s) {
+  size_t capacity = (s.capacity == 0) ? InitialCapacity : s.capacity * 2;
+  auto entries = static_cast<Entry*>(Arena::Allocate(capacity * sizeof(Entry)));
+
+  if (entries == nullptr) {
+    return false;
+  }
+
+  ::memset(entries, 0, capacity * sizeof(Entry));
+
+  size_t const mask = capacity - 1;
+
+  for (size_t i = 0; i < s.capacity; ++i) {
+    if (s.entries[i].address == 0) {
+      continue;
+    }
+
+    size_t slot = hash(s.entries[i].address) & mask;
+
+    while (entries[slot].address != 0) {
+      slot = (slot + 1) & mask;
+    }
+
+    entries[slot] = s.entries[i];
+  }
+
+  if (s.entries != nullptr) {
+    Arena::Free(s.entries, s.capacity * sizeof(Entry));
+  }
+
+  s.entries  = entries;
+  s.capacity = capacity;
+
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                           explicit instantiations
+// -----------------------------------------------------------------------------
+
+template class debugging::MetadataTable<BlockMetadata>;
+template class debugging::MetadataTable<BlockAddress>;
+
@@ -0,0 +1,271 @@
+
+#ifndef LOUSE_METADATATABLE_H
+#define LOUSE_METADATATABLE_H 1
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include "MemoryAllocation.h"
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                      public types
+// -----------------------------------------------------------------------------
+
+namespace debugging {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief table entry with the full metadata of a memory block
+/// this is used when louse runs without headers. the entry is packed into
+/// 24 bytes, with a 48 bit block size and a 40 bit sequence number
+////////////////////////////////////////////////////////////////////////////////
+
+  struct BlockMetadata {
+    size_t blockSize () const {
+      return size;
+    }
+
+    uint64_t sequence () const {
+      return (static_cast<uint64_t>(sequenceHigh) << 32) | sequenceLow;
+    }
+
+    void setSequence (uint64_t value) {
+      sequenceLow  = static_cast<uint32_t>(value);
+      sequenceHigh = (value >> 32) & 0xff;
+    }
+
+    uintptr_t                    address; // 0 for empty slots
+    uint64_t                     size : 48;
+    MemoryAllocation::AccessType type : 8;
+    uint64_t                     sequenceHigh : 8;
+    uint32_t                     stack;
+    uint32_t                     sequenceLow;
+  };
+
+  static_assert(sizeof(BlockMetadata) == 24, "unexpected metadata table entry size");
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief table entry with only the address of a memory block's header
+/// this is used with compact headers, which have no room for list links
+////////////////////////////////////////////////////////////////////////////////
+
+  struct BlockAddress {
+    size_t blockSize () const {
+      return reinterpret_cast<MemoryAllocation const*>(address)->size;
+    }
+
+    uintptr_t address; // 0 for empty slots
+  };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                               class MetadataTable
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief address-keyed table of memory block entries
+/// the table is split into stripes by address, and each stripe is an 
+/// open-addressing hash table with its own lock. the table's memory comes
+/// from the arena
+////////////////////////////////////////////////////////////////////////////////
+
+  template<typename T> class MetadataTable {
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                      public types
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of stripes
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t const NumStripes = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief type of table entries
+////////////////////////////////////////////////////////////////////////////////
+
+      typedef T Entry;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a table stripe, with its own hash table, lock and statistics
+/// stripes are cache-line aligned to avoid false sharing between them
+////////////////////////////////////////////////////////////////////////////////
+
+      struct alignas(64) Stripe {
+        Stripe ()
+          : lock(), entries(nullptr), capacity(0), used(0),
+            snapshot(nullptr), snapshotSize(0), numAllocations(0), sizeAllocations(0) {
+        }
+
+        mutable std::mutex lock;
+        Entry*             entries;
+        size_t             capacity;
+        size_t             used;
+        Entry*             snapshot;
+        size_t             snapshotSize;
+        uint64_t           numAllocations;
+        uint64_t           sizeAllocations;
+      };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief create the table
+////////////////////////////////////////////////////////////////////////////////
+
+      MetadataTable ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief destroy the table
+////////////////////////////////////////////////////////////////////////////////
+
+      ~MetadataTable ();
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block
+/// returns false if the table cannot grow
+////////////////////////////////////////////////////////////////////////////////
+
+      bool insert (Entry const&);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block again after remove(), e.g. after
+/// resizing the block. the block is not counted as a new allocation. the
+/// total size only changes by the difference to the size the block was
+/// counted with. returns false if the table cannot grow
+////////////////////////////////////////////////////////////////////////////////
+
+      bool restore (Entry const&, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief remove the entry for a memory block, and return it
+/// returns false if the address is not in the table
+////////////////////////////////////////////////////////////////////////////////
+
+      bool remove (void const*, Entry&);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief look up the entry for a memory block
+/// returns false if the address is not in the table
+////////////////////////////////////////////////////////////////////////////////
+
+      bool lookup (void const*, Entry&) const;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief copy all current entries
+/// the copy is used by visit(), so it can run without holding any lock
+////////////////////////////////////////////////////////////////////////////////
+
+      void snapshot ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief call the visitor for all entries saved by snapshot()
+/// iteration stops when the visitor returns false
+////////////////////////////////////////////////////////////////////////////////
+
+      template<typename V> void visit (V const& visitor) const {
+        for (size_t i = 0; i < NumStripes; ++i) {
+          Stripe const& s = stripes_[i];
+
+          for (size_t j = 0; j < s.snapshotSize; ++j) {
+            if (! visitor(s.snapshot[j])) {
+              return;
+            }
+          }
+        }
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get table statistics
+////////////////////////////////////////////////////////////////////////////////
+
+      std::pair<uint64_t, uint64_t> totals () const;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+    private:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hashes an address
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint64_t hash (uintptr_t address) {
+        uint64_t h = address >> 4;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the stripe responsible for an address
+////////////////////////////////////////////////////////////////////////////////
+
+      Stripe& stripe (uintptr_t address) {
+        return stripes_[(hash(address) >> 32) % NumStripes];
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the stripe responsible for an address
+////////////////////////////////////////////////////////////////////////////////
+
+      Stripe const& stripe (uintptr_t address) const {
+        return stripes_[(hash(address) >> 32) % NumStripes];
+      }
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add the entry for a memory block. the block is counted as a new
+/// allocation if requested, and its size is added to the total, minus the
+/// size it was counted with before
+////////////////////////////////////////////////////////////////////////////////
+
+      bool store (Entry const&, bool, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief find the slot of an address in a stripe
+/// returns the stripe's capacity if the address is not in the stripe
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t find (Stripe const&, uintptr_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief double the capacity of a stripe
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool grow (Stripe&);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+    private:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the table stripes
+/// each stripe's counters contain the total number and size of allocations
+/// made in the stripe (ever increasing)
+////////////////////////////////////////////////////////////////////////////////
+
+      Stripe stripes_[NumStripes];
+
+  };
+}
+
+#endif
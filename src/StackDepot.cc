@@ -0,0 +1,276 @@
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "StackDepot.h"
+#include "Arena.h"
+
+using Arena      = debugging::Arena;
+using StackDepot = debugging::StackDepot;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                     private types
+// -----------------------------------------------------------------------------
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a stored stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+  struct Entry {
+    uint64_t hash;
+    uint32_t next;      // id of the next entry in the same bucket
+    uint32_t size;      // number of frames
+    void*    frames[1]; // size frames, followed by a nullptr
+  };
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of hash buckets
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const NumBuckets = 1 << 20;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of entries per id page
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const EntriesPerPage = 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of id pages
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const NumPages = 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief size of the memory chunks that entries are carved from
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const ChunkSize = 1 << 20;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hash buckets, each containing the id of the bucket's first entry
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint32_t> Buckets[NumBuckets];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief pages mapping ids to entries
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<Entry**> Pages[NumPages];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of entries, which is also the last id handed out
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint32_t> NumEntries(0);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief mutex protecting inserts
+////////////////////////////////////////////////////////////////////////////////
+
+static std::mutex InsertLock;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief current chunk position and remaining size
+////////////////////////////////////////////////////////////////////////////////
+
+static char* ChunkPosition = nullptr;
+
+static size_t ChunkRemaining = 0;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private helper functions
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the entry for an id
+////////////////////////////////////////////////////////////////////////////////
+
+static Entry* GetEntry (uint32_t id) {
+  uint32_t index = id - 1;
+
+  return Pages[index / EntriesPerPage].load(std::memory_order_acquire)[index % EntriesPerPage];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief find a stack trace in a bucket chain
+/// returns the id of the stack trace, or 0 if not found
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t FindEntry (uint32_t id, uint64_t hash, void* const* frames, size_t size) {
+  while (id != 0) {
+    Entry const* entry = GetEntry(id);
+
+    if (entry->hash == hash &&
+        entry->size == size &&
+        ::memcmp(&entry->frames[0], frames, size * sizeof(void*)) == 0) {
+      return id;
+    }
+
+    id = entry->next;
+  }
+
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class StackDepot
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief look up a stack trace, and insert it if not yet present
+/// returns the id of the stack trace, or 0 if it cannot be stored
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t StackDepot::Insert (void* const* frames, size_t size) {
+  if (size == 0 || Arena::IsReleased()) {
+    return 0;
+  }
+
+  if (size > MaxFrames) {
+    size = MaxFrames;
+  }
+
+  uint64_t hash = Hash(frames, size);
+  auto& bucket = Buckets[(hash >> 16) % NumBuckets];
+
+  // lock-free lookup first. most stack traces have been seen before
+  uint32_t id = FindEntry(bucket.load(std::memory_order_acquire), hash, frames, size);
+
+  if (id != 0) {
+    return id;
+  }
+
+  std::lock_guard<std::mutex> locker(InsertLock);
+
+  // someone else may have inserted the same stack trace meanwhile
+  uint32_t head = bucket.load(std::memory_order_relaxed);
+  id = FindEntry(head, hash, frames, size);
+
+  if (id != 0) {
+    return id;
+  }
+
+  uint32_t index = NumEntries.load(std::memory_order_relaxed);
+
+  if (index == NumPages * EntriesPerPage) {
+    // depot is full
+    return 0;
+  }
+
+  auto& page = Pages[index / EntriesPerPage];
+  Entry** entries = page.load(std::memory_order_relaxed);
+
+  if (entries == nullptr) {
+    entries = static_cast<Entry**>(Arena::Allocate(EntriesPerPage * sizeof(Entry*)));
+
+    if (entries == nullptr) {
+      return 0;
+    }
+
+    ::memset(entries, 0, EntriesPerPage * sizeof(Entry*));
+
+    page.store(entries, std::memory_order_release);
+  }
+
+  auto entry = static_cast<Entry*>(AllocateEntry(sizeof(Entry) + size * sizeof(void*)));
+
+  if (entry == nullptr) {
+    return 0;
+  }
+
+  entry->hash = hash;
+  entry->next = head;
+  entry->size = static_cast<uint32_t>(size);
+  ::memcpy(&entry->frames[0], frames, size * sizeof(void*));
+  entry->frames[size] = nullptr;
+
+  entries[index % EntriesPerPage] = entry;
+
+  id = index + 1;
+  NumEntries.store(id, std::memory_order_release);
+  bucket.store(id, std::memory_order_release);
+
+  return id;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the nullptr-terminated stack trace for an id
+/// returns a nullptr for id 0, and after the depot memory was released
+////////////////////////////////////////////////////////////////////////////////
+
+void** StackDepot::Get (uint32_t id) {
+  if (id == 0 || Arena::IsReleased()) {
+    return nullptr;
+  }
+
+  return &GetEntry(id)->frames[0];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the number of stored stack traces
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t StackDepot::Size () {
+  return NumEntries.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hashes a stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t StackDepot::Hash (void* const* frames, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= reinterpret_cast<uintptr_t>(frames[i]);
+    hash *= 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+  }
+
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate storage for a new stack trace
+/// entries are carved from larger chunks, and are never freed
+////////////////////////////////////////////////////////////////////////////////
+
+void* StackDepot::AllocateEntry (size_t size) {
+  size = (size + 7) & ~static_cast<size_t>(7);
+
+  if (size > ChunkRemaining) {
+    void* chunk = Arena::Allocate(ChunkSize);
+
+    if (chunk == nullptr) {
+      return nullptr;
+    }
+
+    ChunkPosition  = static_cast<char*>(chunk);
+    ChunkRemaining = ChunkSize;
+  }
+
+  void* memory = static_cast<void*>(ChunkPosition);
+  ChunkPosition  += size;
+  ChunkRemaining -= size;
+
+  return memory;
+}
+
@@ -0,0 +1,93 @@
+
+#ifndef LOUSE_STACKDEPOT_H
+#define LOUSE_STACKDEPOT_H 1
+
+#include <cstdlib>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class StackDepot
+// -----------------------------------------------------------------------------
+
+namespace debugging {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief global append-only store of unique stack traces
+/// each distinct stack trace is stored once and identified by a compact id.
+/// lookups are lock-free, only inserting a previously unseen stack trace
+/// takes a lock. stored stack traces are never removed. the depot's memory
+/// comes from the arena and is released together with it
+////////////////////////////////////////////////////////////////////////////////
+
+  class StackDepot {
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+    private:
+
+      StackDepot () = delete;
+
+      ~StackDepot () = delete;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief look up a stack trace, and insert it if not yet present
+/// returns the id of the stack trace, or 0 if it cannot be stored
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint32_t Insert (void* const*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the nullptr-terminated stack trace for an id
+/// returns a nullptr for id 0, and after the depot memory was released
+////////////////////////////////////////////////////////////////////////////////
+
+      static void** Get (uint32_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the number of stored stack traces
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint64_t Size ();
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                   private methods
+// -----------------------------------------------------------------------------
+
+    private:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hashes a stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint64_t Hash (void* const*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate storage for a new stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+      static void* AllocateEntry (size_t);
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                           public static variables
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of frames in a stored stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t const MaxFrames = 256;
+
+  };
+}
+
+#endif
@@ -1,24 +1,363 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <execinfo.h>
+#include <link.h>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <thread>
+#include <vector>
 
 #define UNW_LOCAL_ONLY
 #include <libunwind.h>
 
+#include "Arena.h"
+#include "StackDepot.h"
 #include "StackResolver.h"
+#include "SymbolCache.h"
+#include "Symbolizer.h"
 #include "Tracker.h"
 
+using Arena         = debugging::Arena;
+using Configuration = debugging::Configuration;
+using LouseScope    = debugging::LouseScope;
+using StackDepot    = debugging::StackDepot;
 using StackResolver = debugging::StackResolver;
+using SymbolCache   = debugging::SymbolCache;
+using Symbolizer    = debugging::Symbolizer;
 using Tracker       = debugging::Tracker;
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief method used for capturing stacktraces
+////////////////////////////////////////////////////////////////////////////////
+
+static Configuration::UnwinderType Unwinder = Configuration::UNWINDER_LIBUNWIND;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief method used for resolving stacktraces
+////////////////////////////////////////////////////////////////////////////////
+
+static Configuration::SymbolizerType SymbolizerMethod = Configuration::SYMBOLIZER_ADDR2LINE;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief lower and upper bound of the current thread's stack
+/// these are determined on the first frame pointer walk in each thread
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread uintptr_t StackLow __attribute__ ((tls_model("initial-exec"))) = 0;
+
+static __thread uintptr_t StackHigh __attribute__ ((tls_model("initial-exec"))) = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the current thread is determining its stack bounds
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread bool InStackBounds __attribute__ ((tls_model("initial-exec"))) = false;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of entries in a thread's unwind cache
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const UnwindCacheSize = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum size of a decoded unwind rule as provided by libunwind
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const UnwindStateSize = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a decoded unwind rule, which is valid for a range of code addresses
+////////////////////////////////////////////////////////////////////////////////
+
+struct UnwindCacheEntry {
+  unw_word_t start;
+  unw_word_t end;   // 0 for empty entries
+  char       state[UnwindStateSize];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a thread's cache of decoded unwind rules, indexed by code address
+////////////////////////////////////////////////////////////////////////////////
+
+struct UnwindCache {
+  UnwindCacheEntry entries[UnwindCacheSize];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief state for looking up the unwind rule of a code address
+////////////////////////////////////////////////////////////////////////////////
+
+struct UnwindRuleLookup {
+  unw_word_t        ip;
+  UnwindCacheEntry* entry;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the current thread's unwind cache
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread UnwindCache* CurrentUnwindCache __attribute__ ((tls_model("initial-exec"))) = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief key for releasing unwind caches on thread exit
+////////////////////////////////////////////////////////////////////////////////
+
+static pthread_key_t UnwindCacheKey;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not unwind caches are used
+////////////////////////////////////////////////////////////////////////////////
+
+static bool UseUnwindCaches = false;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of frames that make up a call site
+/// this includes louse's own frames, so only the innermost frames of the
+/// program are part of a call site
+////////////////////////////////////////////////////////////////////////////////
+
+static int const CallSiteFrames = 6;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of slots in the call site table
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const CallSitesSize = 65536;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief call site table, nullptr if call sites are not used
+/// each slot contains the upper 32 bits of a call site's hash and the id of
+/// its stacktrace, so it can be read and updated atomically
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t>* CallSites = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief one in CallSiteSample stacktraces of known call sites is captured
+/// fully
+////////////////////////////////////////////////////////////////////////////////
+
+static int CallSiteSample = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of reused stacktraces left until the next full one
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread int CallSiteCountdown __attribute__ ((tls_model("initial-exec"))) = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of modules whose allocations are traced
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MaxTracedModules = 32;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of code ranges in a module table
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MaxModuleRanges = 512;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of slots in the cache of code pages outside of all modules
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const ModuleMissSlots = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of frames searched for the caller of louse
+////////////////////////////////////////////////////////////////////////////////
+
+static int const CallerFrames = 12;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief name of a module whose allocations are traced
+////////////////////////////////////////////////////////////////////////////////
+
+struct TracedModule {
+  char const* name;
+  size_t      length;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the executable code of a loaded module
+////////////////////////////////////////////////////////////////////////////////
+
+struct ModuleRange {
+  uintptr_t   start;
+  uintptr_t   end;
+  uintptr_t   base;
+  char const* name;
+  uint64_t    nameHash;
+  bool        traced;
+  bool        own;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the code ranges of all loaded modules, sorted by address
+/// the version is odd while the table is rebuilt, and increases with every
+/// rebuild of any table
+////////////////////////////////////////////////////////////////////////////////
+
+struct ModuleTable {
+  std::atomic<uint64_t> version;
+  unsigned long long adds;
+  unsigned long long subs;
+  size_t             length;
+  ModuleRange        ranges[MaxModuleRanges];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief modules whose allocations are traced
+////////////////////////////////////////////////////////////////////////////////
+
+static TracedModule TracedModules[MaxTracedModules];
+
+static size_t NumTracedModules = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief current module table, nullptr if it was not needed yet
+/// tables are replaced as a whole when modules are loaded or unloaded. the
+/// two tables are used in turn, and readers check the table's version after
+/// reading, so the table can be read without locking
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<ModuleTable*> Modules(nullptr);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the two module tables, allocated on first use
+////////////////////////////////////////////////////////////////////////////////
+
+static ModuleTable* ModuleTables[2] = { nullptr, nullptr };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief last version assigned to a module table
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t LastModulesVersion = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief code pages known to be outside of all modules, e.g. generated code
+/// each slot holds a page number together with the version of the module 
+/// table it was looked up in, so rebuilding the table invalidates all slots
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> ModuleMisses[ModuleMissSlots];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief lock for replacing the module table
+////////////////////////////////////////////////////////////////////////////////
+
+static std::mutex ModulesLock;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief base name of the executable, which has no name in the module list
+////////////////////////////////////////////////////////////////////////////////
+
+static char ProgramName[256];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief leak fingerprints loaded for retracing, nullptr if not retracing
+/// this is an open-addressing hash set of fingerprint keys, with 0 marking
+/// empty slots
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t* Fingerprints = nullptr;
+
+static size_t FingerprintsSize = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of addresses written to addr2line processes before
+/// their results are read. this keeps the pipes from filling up
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MaxBatchSize = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief minimum number of code addresses resolved by a worker thread
+/// smaller sets are not worth starting a thread for
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MinAddressesPerThread = 16;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a running addr2line process for one file
+////////////////////////////////////////////////////////////////////////////////
+
+struct debugging::Addr2LineProcess {
+  Addr2LineProcess* next;
+  pid_t             pid;    // -1 if the process is not running
+  int               input;  // addresses for addr2line
+  int               output; // results of addr2line
+  size_t            length; // number of bytes in buffer
+  char              buffer[4096];
+  char              path[512];
+};
+
+using Addr2LineProcess = debugging::Addr2LineProcess;
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                          private helper functions
 // -----------------------------------------------------------------------------
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes all data to a pipe
+/// SIGPIPE is blocked meanwhile, so the program is not terminated if the 
+/// reading process has gone away
+////////////////////////////////////////////////////////////////////////////////
+
+static bool WriteToPipe (int fd, char const* data, size_t length) {
+  sigset_t pipeSignal;
+  sigset_t previous;
+  ::sigemptyset(&pipeSignal);
+  ::sigaddset(&pipeSignal, SIGPIPE);
+  ::pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+
+  bool success = true;
+
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (n <= 0) {
+      success = false;
+      break;
+    }
+
+    data += n;
+    length -= static_cast<size_t>(n);
+  }
+
+  if (! success && ! ::sigismember(&previous, SIGPIPE)) {
+    // consume the SIGPIPE raised by the failed write
+    struct timespec timeout = { 0, 0 };
+    ::sigtimedwait(&pipeSignal, nullptr, &timeout);
+  }
+
+  ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+  return success;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief converts a uint64_t to a base16 string representation
 ////////////////////////////////////////////////////////////////////////////////
@@ -50,127 +389,1083 @@ static char* NumberToAscii (uint64_t val, char* memory) {
 
 static char* PointerToAscii (void const* val, char* memory) {
   char* buf = NumberToAscii(reinterpret_cast<uint64_t>(val), memory + 32);
+  size_t const length = ::strlen(buf);
 
   // output format is 0x....
-  ::memcpy(memory + 2, buf, ::strlen(buf)); 
+  ::memmove(memory + 2, buf, length); 
   memory[0] = '0';
   memory[1] = 'x';
+  memory[length + 2] = '\0';
 
   return memory;
 }
 
-// -----------------------------------------------------------------------------
-// --SECTION--                                               class StackResolver
-// -----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the bounds of the current thread's stack
+/// pthread_getattr_np() may allocate memory itself. stacktraces of 
+/// allocations made meanwhile are not captured
+////////////////////////////////////////////////////////////////////////////////
 
-// -----------------------------------------------------------------------------
-// --SECTION--                                        constructors / destructors
-// -----------------------------------------------------------------------------
+static bool ThreadStackBounds () {
+  if (StackHigh != 0) {
+    return true;
+  }
+
+  if (InStackBounds) {
+    return false;
+  }
+
+  InStackBounds = true;
+
+  pthread_attr_t attr;
+
+  if (::pthread_getattr_np(::pthread_self(), &attr) == 0) {
+    void* address;
+    size_t size;
+
+    if (::pthread_attr_getstack(&attr, &address, &size) == 0) {
+      StackLow  = reinterpret_cast<uintptr_t>(address);
+      StackHigh = StackLow + size;
+    }
+
+    ::pthread_attr_destroy(&attr);
+  }
+
+  InStackBounds = false;
+
+  return (StackHigh != 0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief create the resolver
+/// @brief releases a thread's unwind cache on thread exit
 ////////////////////////////////////////////////////////////////////////////////
 
-StackResolver::StackResolver ()
-  : directoryLength_(0) {
+static void ReleaseUnwindCache (void* data) {
+  if (data == CurrentUnwindCache) {
+    CurrentUnwindCache = nullptr;
+  }
 
-  determineProgname();
-  determineDirectory();
+  if (! Arena::IsReleased()) {
+    Arena::Free(data, sizeof(UnwindCache));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief gets the current thread's unwind cache, creating it on first use
+/// returns nullptr if the cache cannot be used
+////////////////////////////////////////////////////////////////////////////////
+
+static UnwindCache* ThreadUnwindCache () {
+  if (! UseUnwindCaches || Arena::IsReleased()) {
+    return nullptr;
+  }
+
+  UnwindCache* cache = CurrentUnwindCache;
+
+  if (cache == nullptr) {
+    cache = static_cast<UnwindCache*>(Arena::Allocate(sizeof(UnwindCache)));
+
+    if (cache == nullptr) {
+      return nullptr;
+    }
+
+    ::memset(cache, 0, sizeof(UnwindCache));
+
+    // pthread_setspecific() may allocate memory, which will find the cache
+    CurrentUnwindCache = cache;
+    ::pthread_setspecific(UnwindCacheKey, cache);
+  }
+
+  return cache;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief keeps the unwind rule that covers the looked up code address
+/// this is called by libunwind for all unwind rules of a function
+////////////////////////////////////////////////////////////////////////////////
+
+static int KeepUnwindRule (void* data, void* state, size_t size, unw_word_t start, unw_word_t end) {
+  auto lookup = static_cast<UnwindRuleLookup*>(data);
+
+  if (lookup->ip < start || lookup->ip >= end || size > UnwindStateSize) {
+    return 0;
+  }
+
+  ::memcpy(&lookup->entry->state[0], state, size);
+  lookup->entry->start = start;
+  lookup->entry->end   = end;
+
+  // found, stop iterating
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief moves the cursor to the calling frame, using the thread's unwind
+/// cache. libunwind's own cache blocks all signals on each access, which 
+/// costs two system calls per frame. signal frames are never cached, and are
+/// unwound by libunwind. exactIp tells whether the cursor's address is the 
+/// current instruction rather than a return address
+////////////////////////////////////////////////////////////////////////////////
+
+static int StepCached (unw_cursor_t* cursor, UnwindCache* cache, bool& exactIp) {
+  unw_word_t ip;
+  ::unw_get_reg(cursor, UNW_REG_IP, &ip);
+
+  // a return address may be the first address after the caller's function
+  unw_word_t const lookupIp = exactIp ? ip : ip - 1;
+  UnwindCacheEntry* entry = &cache->entries[((lookupIp * 0x9e3779b97f4a7c15ULL) >> 32) % UnwindCacheSize];
+
+  exactIp = false;
+
+  if (lookupIp >= entry->start && lookupIp < entry->end) {
+    return ::unw_apply_reg_state(cursor, &entry->state[0]);
+  }
+
+  if (::unw_is_signal_frame(cursor) > 0) {
+    // the frame after a signal frame has the interrupted instruction's address
+    exactIp = true;
+    return ::unw_step(cursor);
+  }
+
+  UnwindRuleLookup lookup = { lookupIp, entry };
+  entry->end = 0;
+
+  ::unw_reg_states_iterate(cursor, &KeepUnwindRule, &lookup);
+
+  if (entry->end == 0) {
+    // no unwind rule, e.g. for code without unwind information
+    return ::unw_step(cursor);
+  }
+
+  return ::unw_apply_reg_state(cursor, &entry->state[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief captures return addresses via libunwind
+////////////////////////////////////////////////////////////////////////////////
+
+static __attribute__ ((noinline)) int UnwindLibunwind (void** trace, int frames, int skip) {
+  int traceSize = 0;
+  unw_cursor_t cursor; 
+  unw_context_t uc;
+  unw_word_t ip;
+
+  UnwindCache* cache = ThreadUnwindCache();
+  bool exactIp = true;
+
+  ::unw_getcontext(&uc);
+  ::unw_init_local(&cursor, &uc);
+
+  while (traceSize < frames) {
+    int result = (cache != nullptr) ? StepCached(&cursor, cache, exactIp) : ::unw_step(&cursor);
+
+    if (result <= 0) {
+      break;
+    }
+
+    if (skip > 0) {
+      --skip;
+      continue;
+    }
+
+    ::unw_get_reg(&cursor, UNW_REG_IP, &ip);
+    trace[traceSize++] = reinterpret_cast<void*>(ip);
+  }
+
+  return traceSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief captures return addresses by walking the chain of frame pointers
+/// this requires the program to be compiled with -fno-omit-frame-pointer.
+/// the walk stops at the first frame pointer that is not inside the thread's
+/// stack or that does not point further up the stack, so frames without a
+/// frame pointer end the stacktrace early instead of crashing
+////////////////////////////////////////////////////////////////////////////////
+
+static __attribute__ ((noinline)) int UnwindFramePointers (void** trace, int frames, int skip) {
+  if (! ThreadStackBounds()) {
+    return 0;
+  }
+
+  int traceSize = 0;
+  uintptr_t fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+
+  while (traceSize < frames) {
+    if (fp < StackLow || 
+        fp > StackHigh - 2 * sizeof(uintptr_t) || 
+        (fp & (sizeof(uintptr_t) - 1)) != 0) {
+      break;
+    }
+
+    // the saved frame pointer is followed by the return address
+    uintptr_t const* frame = reinterpret_cast<uintptr_t const*>(fp);
+
+    if (frame[1] == 0) {
+      break;
+    }
+
+    if (skip > 0) {
+      --skip;
+    }
+    else {
+      trace[traceSize++] = reinterpret_cast<void*>(frame[1]);
+    }
+
+    if (frame[0] <= fp) {
+      break;
+    }
+
+    fp = frame[0];
+  }
+
+  return traceSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief captures return addresses via the glibc backtrace() function
+////////////////////////////////////////////////////////////////////////////////
+
+static __attribute__ ((noinline)) int UnwindBacktrace (void** trace, int frames, int skip) {
+  void* buffer[StackDepot::MaxFrames + 16];
+
+  // backtrace() also returns our own frame
+  ++skip;
+
+  int size = frames + skip;
+
+  if (size > static_cast<int>(sizeof(buffer) / sizeof(buffer[0]))) {
+    size = static_cast<int>(sizeof(buffer) / sizeof(buffer[0]));
+  }
+
+  size = ::backtrace(&buffer[0], size);
+
+  int traceSize = 0;
+
+  for (int i = skip; i < size && traceSize < frames; ++i) {
+    trace[traceSize++] = buffer[i];
+  }
+
+  return traceSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief returns the file name of a path
+////////////////////////////////////////////////////////////////////////////////
+
+static char const* BaseName (char const* path) {
+  char const* name = ::strrchr(path, '/');
+  return (name == nullptr) ? path : name + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hashes a module's file name
+/// the name is used instead of the module's address, which differs between
+/// runs
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t HashModuleName (char const* name, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 0x00000100000001b3ULL;
+  }
+
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief computes the key of a leak fingerprint
+/// 0 is never returned, as it marks empty slots
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t FingerprintKey (uint64_t nameHash, uint64_t offset, uint64_t size) {
+  uint64_t key = nameHash;
+
+  key ^= offset;
+  key *= 0x9e3779b97f4a7c15ULL;
+  key ^= key >> 29;
+  key ^= size;
+  key *= 0x9e3779b97f4a7c15ULL;
+  key ^= key >> 32;
+
+  return (key == 0) ? 1 : key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the file name of the executable, which has no name in
+/// the list of loaded modules
+////////////////////////////////////////////////////////////////////////////////
+
+static void DetermineProgramName () {
+  char path[512];
+  ssize_t pathLength = ::readlink("/proc/self/exe", &path[0], sizeof(path) - 1);
+
+  if (pathLength < 0) {
+    pathLength = 0;
+  }
+
+  path[pathLength] = '\0';
+
+  char const* program = BaseName(&path[0]);
+  size_t programLength = ::strlen(program);
+
+  if (programLength >= sizeof(ProgramName)) {
+    programLength = sizeof(ProgramName) - 1;
+  }
+
+  ::memcpy(&ProgramName[0], program, programLength);
+  ProgramName[programLength] = '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not a module name is one of the traced modules
+/// a traced module name matches a module's file name either fully, or up to 
+/// a dot, so libfoo.so matches libfoo.so.1
+////////////////////////////////////////////////////////////////////////////////
+
+static bool IsTracedModule (char const* path) {
+  char const* name = BaseName(path);
+
+  for (size_t i = 0; i < NumTracedModules; ++i) {
+    TracedModule const& module = TracedModules[i];
+
+    if (::strncmp(name, module.name, module.length) == 0 &&
+        (name[module.length] == '\0' || name[module.length] == '.')) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief adds the code ranges of a loaded module to a module table
+////////////////////////////////////////////////////////////////////////////////
+
+static int AddModuleRanges (struct dl_phdr_info* info, size_t size, void* data) {
+  auto table = static_cast<ModuleTable*>(data);
+
+  if (table->length == 0 && size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+    table->adds = info->dlpi_adds;
+    table->subs = info->dlpi_subs;
+  }
+
+  // the executable comes first, and has no name
+  char const* name = info->dlpi_name;
+
+  if (name == nullptr || *name == '\0') {
+    name = &ProgramName[0];
+  }
+
+  bool const traced = IsTracedModule(name);
+  uintptr_t const own = reinterpret_cast<uintptr_t>(&AddModuleRanges);
+
+  name = BaseName(name);
+  uint64_t const nameHash = HashModuleName(name, ::strlen(name));
+
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    ElfW(Phdr) const& header = info->dlpi_phdr[i];
+
+    if (header.p_type != PT_LOAD || (header.p_flags & PF_X) == 0) {
+      continue;
+    }
+
+    if (table->length == MaxModuleRanges) {
+      return 1;
+    }
+
+    ModuleRange range;
+    range.start    = info->dlpi_addr + header.p_vaddr;
+    range.end      = range.start + header.p_memsz;
+    range.base     = info->dlpi_addr;
+    range.name     = name;
+    range.nameHash = nameHash;
+    range.traced   = traced;
+    range.own      = (own >= range.start && own < range.end);
+
+    // keep the ranges sorted
+    size_t j = table->length++;
+
+    while (j > 0 && table->ranges[j - 1].start > range.start) {
+      table->ranges[j] = table->ranges[j - 1];
+      --j;
+    }
+
+    table->ranges[j] = range;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the load bias of the executable, which is the first module
+////////////////////////////////////////////////////////////////////////////////
+
+static int ReadExecutableBias (struct dl_phdr_info* info, size_t, void* data) {
+  *static_cast<uintptr_t*>(data) = info->dlpi_addr;
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief returns the load bias of the executable, which is 0 unless it is
+/// position-independent
+////////////////////////////////////////////////////////////////////////////////
+
+static uintptr_t ExecutableBias () {
+  static uintptr_t const bias = [] () -> uintptr_t {
+    uintptr_t value = 0;
+    ::dl_iterate_phdr(&ReadExecutableBias, &value);
+    return value;
+  }();
+
+  return bias;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the counters of loaded and unloaded modules
+////////////////////////////////////////////////////////////////////////////////
+
+static int ReadModuleCounters (struct dl_phdr_info* info, size_t size, void* data) {
+  auto counters = static_cast<unsigned long long*>(data);
+
+  if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+    counters[0] = info->dlpi_adds;
+    counters[1] = info->dlpi_subs;
+  }
+
+  // the first module is sufficient
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief builds a new module table from the currently loaded modules
+////////////////////////////////////////////////////////////////////////////////
+
+static void BuildModuleTable () {
+  std::lock_guard<std::mutex> locker(ModulesLock);
+
+  if (ProgramName[0] == '\0') {
+    DetermineProgramName();
+  }
+
+  // rebuild the table that is not current. readers still using it will
+  // notice the version change and retry with the current table
+  size_t const index = (Modules.load(std::memory_order_relaxed) == ModuleTables[0]) ? 1 : 0;
+
+  if (ModuleTables[index] == nullptr) {
+    void* memory = Arena::Allocate(sizeof(ModuleTable));
+
+    if (memory == nullptr) {
+      return;
+    }
+
+    ModuleTables[index] = new (memory) ModuleTable();
+    ModuleTables[index]->version.store(0, std::memory_order_relaxed);
+  }
+
+  ModuleTable* table = ModuleTables[index];
+
+  table->version.store(table->version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  table->adds   = 0;
+  table->subs   = 0;
+  table->length = 0;
+
+  ::dl_iterate_phdr(&AddModuleRanges, table);
+
+  LastModulesVersion += 2;
+  table->version.store(LastModulesVersion, std::memory_order_release);
+
+  Modules.store(table, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief finds the code range containing an address
+/// returns nullptr if the address is not in any known module
+////////////////////////////////////////////////////////////////////////////////
+
+static ModuleRange const* FindModuleRange (ModuleTable const* table, uintptr_t address) {
+  size_t low  = 0;
+  size_t high = std::min(table->length, MaxModuleRanges);
+
+  while (low < high) {
+    size_t const middle = low + (high - low) / 2;
+    ModuleRange const& range = table->ranges[middle];
+
+    if (address < range.start) {
+      high = middle;
+    }
+    else if (address >= range.end) {
+      low = middle + 1;
+    }
+    else {
+      return &range;
+    }
+  }
+
+  return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief finds the code range containing an address, and rebuilds the 
+/// module table first if modules were loaded since it was built. the range
+/// is copied, as the table may be rebuilt afterwards. returns false if the
+/// address is not in any module
+////////////////////////////////////////////////////////////////////////////////
+
+static bool FindCurrentModuleRange (uintptr_t address, ModuleRange& result) {
+  uint64_t const page = address >> 12;
+  std::atomic<uint64_t>& miss = ModuleMisses[(page * 0x9e3779b97f4a7c15ULL) >> 58];
+  bool rebuilt = false;
+
+  while (true) {
+    ModuleTable const* table = Modules.load(std::memory_order_acquire);
+
+    if (table == nullptr) {
+      if (rebuilt) {
+        return false;
+      }
+
+      BuildModuleTable();
+      rebuilt = true;
+      continue;
+    }
+
+    uint64_t const version = table->version.load(std::memory_order_acquire);
+
+    if ((version & 1) != 0) {
+      // the table is being rebuilt, so it is not current anymore
+      continue;
+    }
+
+    uint64_t const key = (page << 20) | ((version >> 1) & 0xfffff);
+
+    if (miss.load(std::memory_order_relaxed) == key) {
+      // not in any module, e.g. generated code
+      return false;
+    }
+
+    ModuleRange const* range = FindModuleRange(table, address);
+
+    if (range != nullptr) {
+      result = *range;
+    }
+
+    unsigned long long counters[2] = { table->adds, table->subs };
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (table->version.load(std::memory_order_relaxed) != version) {
+      // the table was rebuilt while reading it
+      continue;
+    }
+
+    if (range != nullptr) {
+      return true;
+    }
+
+    if (rebuilt) {
+      return false;
+    }
+
+    // probably in a module loaded after the table was built
+    unsigned long long const adds = counters[0];
+    unsigned long long const subs = counters[1];
+
+    ::dl_iterate_phdr(&ReadModuleCounters, &counters[0]);
+
+    if (counters[0] == adds && counters[1] == subs) {
+      // not in any module. remember the page until the table is rebuilt
+      miss.store(key, std::memory_order_relaxed);
+      return false;
+    }
+
+    BuildModuleTable();
+    rebuilt = true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief finds the caller of louse, and the code range containing it
+/// the caller is the first return address outside of louse, and is found by
+/// walking the frame pointers of louse's own frames. returns false if the 
+/// caller cannot be determined. range is empty, with a nullptr name, if the
+/// caller is not in any module
+////////////////////////////////////////////////////////////////////////////////
+
+static __attribute__ ((noinline)) bool FindCaller (uintptr_t& caller, ModuleRange& range) {
+  void* frames[CallerFrames];
+  int length = UnwindFramePointers(&frames[0], CallerFrames, 1);
+
+  for (int i = 0; i < length; ++i) {
+    caller = reinterpret_cast<uintptr_t>(frames[i]);
+
+    if (! FindCurrentModuleRange(caller, range)) {
+      range = ModuleRange();
+      return true;
+    }
+
+    if (! range.own) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief hashes the return addresses of a call site
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t HashCallSite (void* const* frames, int length) {
+  uint64_t hash = 0;
+
+  for (int i = 0; i < length; ++i) {
+    hash ^= reinterpret_cast<uintptr_t>(frames[i]);
+    hash *= 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+  }
+
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief captures return addresses of the current thread
+/// the first address is in the function calling Unwind(), unless it is
+/// left out via skip
+////////////////////////////////////////////////////////////////////////////////
+
+static __attribute__ ((noinline)) int Unwind (void** trace, int frames, int skip) {
+  // one additional frame for ourselves
+  ++skip;
+
+  switch (Unwinder) {
+    case Configuration::UNWINDER_FRAMEPOINTER: return UnwindFramePointers(trace, frames, skip);
+    case Configuration::UNWINDER_BACKTRACE:    return UnwindBacktrace(trace, frames, skip);
+    default:                                   return UnwindLibunwind(trace, frames, skip);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                               class StackResolver
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief create the resolver
+////////////////////////////////////////////////////////////////////////////////
+
+StackResolver::StackResolver ()
+  : processes_(nullptr),
+    directoryLength_(0) {
+
+  determineProgname();
+  determineDirectory();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief destroy the resolver
+////////////////////////////////////////////////////////////////////////////////
+
+StackResolver::~StackResolver () {
+  while (processes_ != nullptr) {
+    Addr2LineProcess* process = processes_;
+    processes_ = process->next;
+
+    if (process->pid > 0) {
+      // addr2line exits when its input is closed
+      ::close(process->input);
+      ::close(process->output);
+      ::waitpid(process->pid, nullptr, 0);
+    }
+
+    Arena::Free(process, sizeof(Addr2LineProcess));
+  }
+
+  for (auto& it : cache_) {
+    Arena::Free(it.second, ::strlen(it.second) + 1);
+  }
+  cache_.clear();
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sets the method used for capturing stacktraces
+/// this must be called before any stacktrace is captured. glibc loads the
+/// unwinder used by backtrace() on first use, which allocates memory, so 
+/// backtrace() is called once here already
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::SetUnwinder (Configuration::UnwinderType unwinder) {
+  if (unwinder == Configuration::UNWINDER_LIBUNWIND) {
+    // libunwind's own cache is still used for frames that louse does not 
+    // cache. a per-thread cache avoids contention on its global lock
+    ::unw_set_caching_policy(unw_local_addr_space, UNW_CACHE_PER_THREAD);
+
+    UseUnwindCaches = (::pthread_key_create(&UnwindCacheKey, &ReleaseUnwindCache) == 0);
+  }
+
+  if (unwinder == Configuration::UNWINDER_BACKTRACE) {
+    void* buffer[1];
+    ::backtrace(&buffer[0], 1);
+  }
+
+  Unwinder = unwinder;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sets the method used for resolving stacktraces
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::SetSymbolizer (Configuration::SymbolizerType symbolizer) {
+  SymbolizerMethod = symbolizer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief makes captureStackTrace() reuse the stacktraces of known call sites
+/// this must be called before any stacktrace is captured
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::UseCallSites (int sample) {
+  void* memory = Arena::Allocate(CallSitesSize * sizeof(std::atomic<uint64_t>));
+
+  if (memory == nullptr) {
+    return;
+  }
+
+  ::memset(memory, 0, CallSitesSize * sizeof(std::atomic<uint64_t>));
+
+  CallSiteSample = sample;
+  CallSites      = static_cast<std::atomic<uint64_t>*>(memory);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief restricts tracing to allocations from the given modules
+/// the modules are given as a comma-separated list of file names. the 
+/// executable is named like its file
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::SetTracedModules (char const* names) {
+  size_t const length = ::strlen(names);
+  auto copy = static_cast<char*>(Arena::Allocate(length + 1));
+
+  if (copy == nullptr) {
+    return;
+  }
+
+  ::memcpy(copy, names, length + 1);
+
+  NumTracedModules = 0;
+
+  for (char* name = ::strtok(copy, ","); 
+       name != nullptr && NumTracedModules < MaxTracedModules;
+       name = ::strtok(nullptr, ",")) {
+    TracedModules[NumTracedModules].name   = name;
+    TracedModules[NumTracedModules].length = ::strlen(name);
+    ++NumTracedModules;
+  }
+
+  BuildModuleTable();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief rebuilds the table of loaded modules
+/// this must be called after modules were unloaded. newly loaded modules
+/// are detected when one of their addresses is looked up
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::RefreshModules () {
+  if (Modules.load(std::memory_order_acquire) != nullptr) {
+    BuildModuleTable();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the caller of louse is in one of the traced modules
+/// this is true if tracing is not restricted to modules
+////////////////////////////////////////////////////////////////////////////////
+
+bool StackResolver::IsTracedCaller () {
+  if (NumTracedModules == 0) {
+    return true;
+  }
+
+  uintptr_t caller;
+  ModuleRange range;
+
+  if (! FindCaller(caller, range)) {
+    // the caller was not found
+    return true;
+  }
+
+  return range.traced;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief stores the caller of louse in the stack depot
+/// returns the id of a stacktrace with only the caller, or 0 on failure
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t StackResolver::captureCaller () {
+  uintptr_t caller;
+  ModuleRange range;
+
+  if (! FindCaller(caller, range)) {
+    return 0;
+  }
+
+  void* trace[1] = { reinterpret_cast<void*>(caller) };
+
+  return StackDepot::Insert(&trace[0], 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief formats the fingerprint of a leak, which consists of the module
+/// name and offset of the allocation's caller, and the allocation's size
+/// returns the length of the fingerprint, or 0 if the caller is not in any
+/// module
+////////////////////////////////////////////////////////////////////////////////
+
+size_t StackResolver::FormatFingerprint (void* caller, size_t size, char* buffer, size_t length) {
+  uintptr_t const address = reinterpret_cast<uintptr_t>(caller);
+  ModuleRange range;
+
+  if (! FindCurrentModuleRange(address, range)) {
+    return 0;
+  }
+
+  int written = ::snprintf(buffer, length, "%s 0x%llx %llu\n",
+                           range.name,
+                           static_cast<unsigned long long>(address - range.base),
+                           static_cast<unsigned long long>(size));
+
+  if (written < 0 || static_cast<size_t>(written) >= length) {
+    return 0;
+  }
+
+  return static_cast<size_t>(written);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief loads leak fingerprints written by a previous run
+/// each line contains the module name, offset and size of a leak, as 
+/// written by FormatFingerprint(). other lines are ignored
+////////////////////////////////////////////////////////////////////////////////
+
+bool StackResolver::LoadFingerprints (char const* filename) {
+  int fd = ::open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+
+  if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  size_t const fileSize = static_cast<size_t>(info.st_size);
+  auto contents = static_cast<char*>(Arena::Allocate(fileSize + 1));
+
+  if (contents == nullptr) {
+    ::close(fd);
+    return false;
+  }
+
+  size_t position = 0;
+
+  while (position < fileSize) {
+    ssize_t n = ::read(fd, contents + position, fileSize - position);
+
+    if (n <= 0) {
+      break;
+    }
+
+    position += static_cast<size_t>(n);
+  }
+
+  ::close(fd);
+  contents[position] = '\0';
+
+  // a line has at least 6 characters, and the set is kept at most half full
+  size_t capacity = 64;
+
+  while (capacity < position / 3) {
+    capacity *= 2;
+  }
+
+  auto set = static_cast<uint64_t*>(Arena::Allocate(capacity * sizeof(uint64_t)));
+
+  if (set == nullptr) {
+    Arena::Free(contents, fileSize + 1);
+    return false;
+  }
+
+  ::memset(set, 0, capacity * sizeof(uint64_t));
+
+  char* line = contents;
+
+  while (*line != '\0') {
+    char* next = ::strchr(line, '\n');
+
+    if (next != nullptr) {
+      *next++ = '\0';
+    }
+    else {
+      next = line + ::strlen(line);
+    }
+
+    char* end = ::strchr(line, ' ');
+
+    if (end != nullptr && line[0] != '#') {
+      char* p;
+      unsigned long long offset = ::strtoull(end + 1, &p, 16);
+      unsigned long long size   = ::strtoull(p, &p, 10);
+
+      if (*p == '\0') {
+        uint64_t const key = FingerprintKey(HashModuleName(line, end - line), offset, size);
+        size_t slot = key & (capacity - 1);
+
+        while (set[slot] != 0 && set[slot] != key) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+
+        set[slot] = key;
+      }
+    }
+
+    line = next;
+  }
+
+  Arena::Free(contents, fileSize + 1);
+
+  FingerprintsSize = capacity;
+  Fingerprints     = set;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the caller of louse and the size of its allocation
+/// match one of the fingerprints loaded
+////////////////////////////////////////////////////////////////////////////////
+
+bool StackResolver::IsFingerprinted (size_t size) {
+  if (Fingerprints == nullptr) {
+    return false;
+  }
+
+  uintptr_t caller;
+  ModuleRange range;
+
+  if (! FindCaller(caller, range) || range.name == nullptr) {
+    return false;
+  }
+
+  uint64_t const key = FingerprintKey(range.nameHash, caller - range.base, size);
+  size_t slot = key & (FingerprintsSize - 1);
+
+  while (Fingerprints[slot] != 0) {
+    if (Fingerprints[slot] == key) {
+      return true;
+    }
+    slot = (slot + 1) & (FingerprintsSize - 1);
+  }
+
+  return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief destroy the resolver
+/// @brief captures a stacktrace and stores it in the stack depot
+/// returns the id of the stacktrace in the depot, or 0 on failure. 
+/// with call sites in use, a call site is identified by the innermost 
+/// return addresses, which are found by walking the frame pointers. this is 
+/// cheap, and works for louse's own frames in any case. a full stacktrace is
+/// only captured on the first call from a call site and for one in 
+/// CallSiteSample calls. other calls reuse the call site's last stacktrace, 
+/// whose outer frames may differ from the actual ones
 ////////////////////////////////////////////////////////////////////////////////
 
-StackResolver::~StackResolver () {
-  for (auto& it : cache_) {
-    Tracker::LibraryFree(it.second);
-  }
-  cache_.clear();
-}
+uint32_t StackResolver::captureStackTrace (int maxFrames) {
+  std::atomic<uint64_t>* slot = nullptr;
+  uint64_t tag = 0;
 
-// -----------------------------------------------------------------------------
-// --SECTION--                                                    public methods
-// -----------------------------------------------------------------------------
+  if (CallSites != nullptr && ! Arena::IsReleased()) {
+    void* callSite[CallSiteFrames];
 
-////////////////////////////////////////////////////////////////////////////////
-/// @brief captures a stacktrace
-////////////////////////////////////////////////////////////////////////////////
+    // leave out our own frame
+    int length = UnwindFramePointers(&callSite[0], CallSiteFrames, 1);
 
-void** StackResolver::captureStackTrace (int maxFrames) {
-  char memory[256];
+    if (length > 0) {
+      uint64_t const hash = HashCallSite(&callSite[0], length);
 
-  void** trace = reinterpret_cast<void**>(memory);
+      slot = &CallSites[hash % CallSitesSize];
+      tag  = hash >> 32;
 
-  int frames = maxFrames + 2;
+      uint64_t const entry = slot->load(std::memory_order_relaxed);
 
-  while (frames * sizeof(void*) > sizeof(memory)) {
-    --frames;
+      if ((entry >> 32) == tag && 
+          static_cast<uint32_t>(entry) != 0 && 
+          --CallSiteCountdown > 0) {
+        return static_cast<uint32_t>(entry);
+      }
+    }
   }
 
-  int traceSize = 0;
-  unw_cursor_t cursor; 
-  unw_context_t uc;
-  unw_word_t ip;
+  void* trace[StackDepot::MaxFrames];
 
-  ::unw_getcontext(&uc);
-  ::unw_init_local(&cursor, &uc);
+  int frames = maxFrames;
 
-  while (traceSize < frames && ::unw_step(&cursor) > 0) {
-    ::unw_get_reg(&cursor, UNW_REG_IP, &ip);
-    trace[traceSize++] = (void*) ip;
+  if (frames > static_cast<int>(sizeof(trace) / sizeof(trace[0]))) {
+    frames = static_cast<int>(sizeof(trace) / sizeof(trace[0]));
   }
 
-  if (traceSize < 2) {
-    return nullptr;
+  // leave out our own frame and the frame of the tracker that called us
+  int traceSize = Unwind(&trace[0], frames, 2);
+
+  if (traceSize < 1) {
+    return 0;
   }
 
-  void** pcs = static_cast<void**>(Tracker::LibraryMalloc(sizeof(void*) * traceSize));
+  uint32_t id = StackDepot::Insert(&trace[0], traceSize);
 
-  if (pcs == nullptr) {
-    return nullptr;
+  if (slot != nullptr && id != 0) {
+    slot->store((tag << 32) | id, std::memory_order_relaxed);
+    CallSiteCountdown = CallSiteSample;
   }
 
-  ::memcpy(&pcs[0], trace + 1, sizeof(void*) * (traceSize - 1));
-  pcs[traceSize - 1] = nullptr;
-
-  return pcs;
+  return id;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief captures a stacktrace
+/// the stacktrace is terminated by a nullptr
 ////////////////////////////////////////////////////////////////////////////////
 
 bool StackResolver::captureStackTrace (int maxFrames, void** memory, int length) {
-  int frames = maxFrames + 2;
-
-  while (frames >= length) {
-    --frames;
-  }
-
-  int traceSize = 0;
-  unw_cursor_t cursor; 
-  unw_context_t uc;
-  unw_word_t ip;
-
-  ::unw_getcontext(&uc);
-  ::unw_init_local(&cursor, &uc);
+  int frames = maxFrames;
 
-  int i = 0;
-  while (traceSize < frames && ::unw_step(&cursor) > 0) {
-    ::unw_get_reg(&cursor, UNW_REG_IP, &ip);
-    if (i > 0) {
-      memory[traceSize++] = (void*) ip;
-    }
-    ++i;
+  if (frames > length - 1) {
+    frames = length - 1;
   }
-  memory[i] = nullptr;
 
-  if (traceSize < 1) {
-    return false;
-  }
+  // leave out our own frame and the frame of our caller
+  int traceSize = Unwind(memory, frames, 2);
+  memory[traceSize] = nullptr;
 
-  return true;
+  return (traceSize > 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -182,6 +1477,10 @@ char* StackResolver::resolveStack (int maxFrames, bool useColors, char* memory,
     return nullptr;
   }
 
+  if (SymbolizerMethod == Configuration::SYMBOLIZER_ADDR2LINE) {
+    resolveBatch(maxFrames, useColors, stack);
+  }
+
   char* start = memory;
   int frames = 0;
 
@@ -200,41 +1499,18 @@ char* StackResolver::resolveStack (int maxFrames, bool useColors, char* memory,
       memory += len;
     } 
     else {
-      Dl_info dlinf;
-      char* line;
-      if (::dladdr(pc, &dlinf) == 0 || 
-          dlinf.dli_fname[0] != '/' || 
-          ! ::strcmp(progname(), dlinf.dli_fname)) {
-        line = addr2line(useColors, 
-                         progname(), 
-                         pc, 
-                         &memory);
-      } 
-      else {
-        line = addr2line(useColors,
-                         dlinf.dli_fname, 
-                         reinterpret_cast<void*>(reinterpret_cast<char*>(pc) - reinterpret_cast<char*>(dlinf.dli_fbase)), 
-                         &memory);
-      }
+      char const* prog;
+      void* base;
+      locateAddress(pc, &prog, &base);
+
+      char* line = resolveAddress(useColors, prog, base, pc, &memory);
 
       if (line == nullptr) {
         return nullptr;
       }
 
-      size_t len = ::strlen(line); 
-      char* copy = static_cast<char*>(Tracker::LibraryMalloc(len + 1));
-
-      if (copy != nullptr) {
-        ::memcpy(copy, line, len);
-        copy[len] = '\0';
-
-        try {
-          cache_.emplace(pc, static_cast<char*>(copy));
-        }
-        catch (...) {
-          Tracker::LibraryFree(copy);
-        }
-      }
+      *memory = '\0';
+      cacheLine(pc, line);
     }
 
     *memory = '\0';
@@ -257,53 +1533,524 @@ char* StackResolver::resolveStack (int maxFrames, bool useColors, char* memory,
   return start;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves the code addresses of several stacktraces up front, using
+/// up to the given number of threads. the unique addresses not yet cached are
+/// sorted, and each thread resolves a disjoint range of them with a resolver
+/// of its own, so addresses of the same file mostly end up in the same thread.
+/// the results are added to the cache in address order afterwards, so the 
+/// output of resolveStack() does not depend on the number of threads
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::resolveStacks (int maxFrames, bool useColors, void** const* stacks, size_t n, int threads) {
+  if (threads <= 1) {
+    // resolveStack() resolves the addresses on demand
+    return;
+  }
+
+  std::vector<void*, ArenaAllocator<void*>> pcs;
+
+  try {
+    for (size_t i = 0; i < n; ++i) {
+      void** stack = stacks[i];
+
+      if (stack == nullptr) {
+        continue;
+      }
+
+      for (int frames = 0; *stack != nullptr && frames < maxFrames; ++stack, ++frames) {
+        if (cache_.find(*stack) == cache_.end()) {
+          pcs.emplace_back(*stack);
+        }
+      }
+    }
+
+    std::sort(pcs.begin(), pcs.end());
+    pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+
+    // resolveBatch() expects a terminated list of addresses
+    pcs.emplace_back(nullptr);
+  }
+  catch (...) {
+    return;
+  }
+
+  size_t const numPcs = pcs.size() - 1;
+  size_t numThreads = numPcs / MinAddressesPerThread;
+
+  if (numThreads > static_cast<size_t>(threads)) {
+    numThreads = static_cast<size_t>(threads);
+  }
+
+  if (numThreads <= 1) {
+    return;
+  }
+
+  void* memory = Arena::Allocate(numThreads * sizeof(StackResolver));
+
+  if (memory == nullptr) {
+    return;
+  }
+
+  StackResolver* resolvers = static_cast<StackResolver*>(memory);
+  std::thread workers[Configuration::MaxSymbolizeThreads];
+  size_t const chunk = (numPcs + numThreads - 1) / numThreads;
+
+  for (size_t i = 0; i < numThreads; ++i) {
+    new (&resolvers[i]) StackResolver();
+
+    size_t const start = i * chunk;
+    size_t const count = std::min(chunk, numPcs - std::min(start, numPcs));
+
+    try {
+      workers[i] = std::thread(&StackResolver::resolveAddresses, &resolvers[i], useColors, &pcs[start], count);
+    }
+    catch (...) {
+      // no more threads available. resolve the range in this thread
+      resolvers[i].resolveAddresses(useColors, &pcs[start], count);
+    }
+  }
+
+  for (size_t i = 0; i < numThreads; ++i) {
+    if (workers[i].joinable()) {
+      workers[i].join();
+    }
+  }
+
+  // take over the texts of the workers, in the order of the addresses
+  for (size_t i = 0; i < numThreads; ++i) {
+    auto& cache = resolvers[i].cache_;
+    size_t const start = i * chunk;
+    size_t const end = std::min(start + chunk, numPcs);
+
+    for (size_t j = start; j < end; ++j) {
+      auto it = cache.find(pcs[j]);
+
+      if (it == cache.end()) {
+        continue;
+      }
+
+      try {
+        if (cache_.emplace(pcs[j], (*it).second).second) {
+          cache.erase(it);
+        }
+      }
+      catch (...) {
+        // the worker's resolver frees the text
+      }
+    }
+
+    resolvers[i].~StackResolver();
+  }
+
+  Arena::Free(memory, numThreads * sizeof(StackResolver));
+}
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                   private methods
 // -----------------------------------------------------------------------------
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief calls addr2line 
+/// @brief determines the file containing a code address, and the address
+/// the file is loaded at. the base address is a nullptr if it is unknown
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::locateAddress (void* pc, char const** prog, void** base) {
+  Dl_info dlinf;
+
+  if (::dladdr(pc, &dlinf) == 0) {
+    *prog = progname();
+    *base = nullptr;
+  }
+  else if (dlinf.dli_fname[0] != '/' || 
+           ! ::strcmp(progname(), dlinf.dli_fname)) {
+    *prog = progname();
+    *base = dlinf.dli_fbase;
+  } 
+  else {
+    *prog = dlinf.dli_fname;
+    *base = dlinf.dli_fbase;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a code address in the given file, which is loaded at the
+/// given base address. the base address is a nullptr for the executable if
+/// it is unknown
+////////////////////////////////////////////////////////////////////////////////
+
+char* StackResolver::resolveAddress (bool useColors, char const* prog, void* base, void* pc, char** memory) {
+  char lineBuffer[1024];
+
+  if (SymbolCache::Lookup(pc, &lineBuffer[0], sizeof(lineBuffer))) {
+    return formatLine(useColors, &lineBuffer[0], ::strlen(lineBuffer), memory);
+  }
+
+  if (SymbolizerMethod == Configuration::SYMBOLIZER_BUILTIN) {
+    if (Symbolizer::Symbolize(prog, base, pc, &lineBuffer[0], sizeof(lineBuffer))) {
+      if (::strncmp(lineBuffer, "??\n", 3) != 0) {
+        // as with addr2line, unknown functions are left to the next run
+        SymbolCache::Store(pc, &lineBuffer[0]);
+      }
+      return formatLine(useColors, &lineBuffer[0], ::strlen(lineBuffer), memory);
+    }
+
+    // no line numbers, e.g. because the debug sections are compressed. 
+    // addr2line may do better, and the builtin result is used otherwise
+    char* result = addr2line(useColors, prog, base, pc, memory);
+
+    if (result != nullptr) {
+      return result;
+    }
+
+    return formatLine(useColors, &lineBuffer[0], ::strlen(lineBuffer), memory);
+  }
+
+  return addr2line(useColors, prog, base, pc, memory);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief stores the resolved text for a code address in the cache
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::cacheLine (void* pc, char const* line) {
+  size_t len = ::strlen(line); 
+  char* copy = static_cast<char*>(Arena::Allocate(len + 1));
+
+  if (copy == nullptr) {
+    return;
+  }
+
+  ::memcpy(copy, line, len);
+  copy[len] = '\0';
+
+  try {
+    if (! cache_.emplace(pc, copy).second) {
+      Arena::Free(copy, len + 1);
+    }
+  }
+  catch (...) {
+    Arena::Free(copy, len + 1);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves all addresses of a stacktrace that are not yet cached
+/// via addr2line. the addresses are written to the addr2line processes 
+/// before any result is read, so the processes work in parallel with louse
+/// and the pipes are never idle
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::resolveBatch (int maxFrames, bool useColors, void** stack) {
+  struct Request {
+    void*             pc;
+    Addr2LineProcess* process;
+  };
+
+  Request requests[MaxBatchSize];
+  size_t numRequests = 0;
+
+  auto collect = [&] () {
+    for (size_t i = 0; i < numRequests; ++i) {
+      char line[2048];
+      char* memory = &line[0];
+      line[0] = '\0';
+
+      if (readAddress(useColors, requests[i].process, requests[i].pc, &memory) != nullptr) {
+        *memory = '\0';
+        cacheLine(requests[i].pc, &line[0]);
+      }
+    }
+
+    numRequests = 0;
+  };
+
+  for (int frames = 0; *stack != nullptr && frames < maxFrames; ++stack, ++frames) {
+    void* pc = *stack;
+
+    if (cache_.find(pc) != cache_.end()) {
+      continue;
+    }
+
+    bool duplicate = false;
+
+    for (size_t i = 0; i < numRequests; ++i) {
+      if (requests[i].pc == pc) {
+        duplicate = true;
+        break;
+      }
+    }
+
+    if (duplicate) {
+      continue;
+    }
+
+    char text[1024];
+
+    if (SymbolCache::Lookup(pc, &text[0], sizeof(text))) {
+      char line[2048];
+      char* memory = &line[0];
+      line[0] = '\0';
+
+      formatLine(useColors, &text[0], ::strlen(text), &memory);
+      *memory = '\0';
+      cacheLine(pc, &line[0]);
+      continue;
+    }
+
+    char const* prog;
+    void* base;
+    locateAddress(pc, &prog, &base);
+
+    Addr2LineProcess* process = addr2lineProcess(prog);
+
+    if (process == nullptr || ! requestAddress(process, prog, base, pc)) {
+      continue;
+    }
+
+    requests[numRequests].pc      = pc;
+    requests[numRequests].process = process;
+
+    if (++numRequests == MaxBatchSize) {
+      collect();
+    }
+  }
+
+  collect();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a range of code addresses into the cache. this is run by
+/// the worker threads of resolveStacks(), each with a resolver of its own.
+/// the range must be followed by a nullptr or another address
+////////////////////////////////////////////////////////////////////////////////
+
+void StackResolver::resolveAddresses (bool useColors, void** pcs, size_t count) {
+  // allocations made while resolving are not traced
+  LouseScope scope;
+
+  if (SymbolizerMethod == Configuration::SYMBOLIZER_ADDR2LINE) {
+    resolveBatch(static_cast<int>(count), useColors, pcs);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    void* pc = pcs[i];
+
+    if (cache_.find(pc) != cache_.end()) {
+      continue;
+    }
+
+    char const* prog;
+    void* base;
+    locateAddress(pc, &prog, &base);
+
+    char line[2048];
+    char* memory = &line[0];
+    line[0] = '\0';
+
+    if (resolveAddress(useColors, prog, base, pc, &memory) != nullptr) {
+      *memory = '\0';
+      cacheLine(pc, &line[0]);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief returns the addr2line process for a file, starting it if required
+/// returns a nullptr if the process cannot be started or has failed
 ////////////////////////////////////////////////////////////////////////////////
 
-char* StackResolver::addr2line (bool useColors, char const* prog, void* pc, char** memory) {
-  int pipefd[2];
+Addr2LineProcess* StackResolver::addr2lineProcess (char const* prog) {
+  Addr2LineProcess* process = processes_;
+
+  while (process != nullptr) {
+    if (::strcmp(process->path, prog) == 0) {
+      return (process->pid > 0) ? process : nullptr;
+    }
+    process = process->next;
+  }
+
+  size_t const length = ::strlen(prog);
+
+  if (length >= sizeof(process->path)) {
+    return nullptr;
+  }
+
+  process = static_cast<Addr2LineProcess*>(Arena::Allocate(sizeof(Addr2LineProcess)));
+
+  if (process == nullptr) {
+    return nullptr;
+  }
+
+  ::memcpy(process->path, prog, length + 1);
+  process->pid    = -1;
+  process->length = 0;
+  process->next   = processes_;
+  processes_      = process;
+
+  // the parent's ends of the pipes must not leak into other processes
+  int input[2];
+  int output[2];
 
-  if (::pipe(pipefd) != 0) {
+  if (::pipe2(input, O_CLOEXEC) != 0) {
+    return nullptr;
+  }
+
+  if (::pipe2(output, O_CLOEXEC) != 0) {
+    ::close(input[0]);
+    ::close(input[1]);
     return nullptr;
   }
 
   pid_t pid = ::fork();
 
   if (pid == 0) {
-    ::close(pipefd[0]);
-    ::dup2(pipefd[1], STDOUT_FILENO);
-    ::dup2(pipefd[1], STDERR_FILENO);
+    ::dup2(input[0], STDIN_FILENO);
+    ::dup2(output[1], STDOUT_FILENO);
+
+    // warnings must not end up in the output, which is read two lines per
+    // address. the process lives on, so one warning would shift all results
+    int null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    if (null >= 0) {
+      ::dup2(null, STDERR_FILENO);
+    }
 
     // do not pass LD_PRELOAD to sub-shell    
     char const* env[] = { nullptr };
 
-    if (::execle("/usr/bin/addr2line", "addr2line", PointerToAscii(pc, *memory), "-C", "-f", "-e", prog, nullptr, env) == -1) {
-      ::close(pipefd[1]);
-      std::exit(1);
-    }
+    // without addresses as arguments, addr2line reads them from its input
+    // and flushes its output after each one
+    ::execle("/usr/bin/addr2line", "addr2line", "-C", "-f", "-e", prog, nullptr, env);
+    ::_exit(1);
   }
 
-  ::close(pipefd[1]);
+  ::close(input[0]);
+  ::close(output[1]);
 
-  char lineBuffer[1024];
-  ssize_t len = ::read(pipefd[0], &lineBuffer[0], sizeof(lineBuffer) - 1);
-  ::close(pipefd[0]);
+  if (pid < 0) {
+    ::close(input[1]);
+    ::close(output[0]);
+    return nullptr;
+  }
+
+  process->pid    = pid;
+  process->input  = input[1];
+  process->output = output[0];
+
+  return process;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes a code address to an addr2line process
+/// addr2line expects the addresses as they are in the file. these are the
+/// offsets from the load address for shared libraries and for position-
+/// independent executables
+////////////////////////////////////////////////////////////////////////////////
+
+bool StackResolver::requestAddress (Addr2LineProcess* process, char const* prog, void* base, void* pc) {
+  if (::strcmp(progname(), prog) == 0) {
+    pc = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(pc) - ExecutableBias());
+  }
+  else if (base != nullptr) {
+    pc = reinterpret_cast<void*>(reinterpret_cast<char*>(pc) - reinterpret_cast<char*>(base));
+  }
+
+  char buffer[64];
+  char* address = PointerToAscii(pc, &buffer[0]);
+  size_t length = ::strlen(address);
+  address[length++] = '\n';
+
+  if (! WriteToPipe(process->input, address, length)) {
+    // addr2line has gone away
+    ::close(process->input);
+    ::close(process->output);
+    ::waitpid(process->pid, nullptr, 0);
+    process->pid = -1;
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the result for the next address from an addr2line process
+/// the result consists of two lines, the function name and `file:line`
+////////////////////////////////////////////////////////////////////////////////
 
-  if (len == 0) {
+char* StackResolver::readAddress (bool useColors, Addr2LineProcess* process, void* pc, char** memory) {
+  if (process->pid <= 0) {
     return nullptr;
   }
 
+  char lineBuffer[1024];
+  size_t len = 0;
+
+  for (int lines = 0; lines < 2; ++lines) {
+    char* nl;
+
+    while ((nl = static_cast<char*>(::memchr(process->buffer, '\n', process->length))) == nullptr) {
+      if (process->length == sizeof(process->buffer)) {
+        // overlong line. take it as it is
+        nl = &process->buffer[process->length - 1];
+        break;
+      }
+
+      ssize_t n = ::read(process->output, 
+                         &process->buffer[process->length], 
+                         sizeof(process->buffer) - process->length);
+
+      if (n <= 0) {
+        ::close(process->input);
+        ::close(process->output);
+        ::waitpid(process->pid, nullptr, 0);
+        process->pid = -1;
+        return nullptr;
+      }
+
+      process->length += static_cast<size_t>(n);
+    }
+
+    size_t const lineLength = nl - process->buffer + 1;
+    size_t const copyLength = std::min(lineLength, sizeof(lineBuffer) - 1 - len);
+
+    ::memcpy(&lineBuffer[len], process->buffer, copyLength);
+    len += copyLength;
+
+    process->length -= lineLength;
+    ::memmove(process->buffer, nl + 1, process->length);
+  }
+
   lineBuffer[len] = '\0';
 
-  if (::waitpid(pid, nullptr, 0) != pid) {
+  if (::strncmp(lineBuffer, "??\n", 3) != 0) {
+    // addresses addr2line cannot resolve are left to the next run
+    SymbolCache::Store(pc, &lineBuffer[0]);
+  }
+
+  return formatLine(useColors, &lineBuffer[0], len, memory);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a code address via addr2line
+////////////////////////////////////////////////////////////////////////////////
+
+char* StackResolver::addr2line (bool useColors, char const* prog, void* base, void* pc, char** memory) {
+  Addr2LineProcess* process = addr2lineProcess(prog);
+
+  if (process == nullptr || ! requestAddress(process, prog, base, pc)) {
     return nullptr;
   }
 
+  return readAddress(useColors, process, pc, memory);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief appends the output of addr2line for an address, formatted as a
+/// line of a stacktrace
+////////////////////////////////////////////////////////////////////////////////
+
+char* StackResolver::formatLine (bool useColors, char* lineBuffer, size_t len, char** memory) {
   char* p = &lineBuffer[0];
   char* nl = ::strchr(p, '\n');
 /*          
@@ -2,13 +2,19 @@
 #ifndef LOUSE_STACKRESOLVER_H
 #define LOUSE_STACKRESOLVER_H 1
 
+#include <cstdint>
 #include <unordered_map>
 
+#include "Arena.h"
+#include "Configuration.h"
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                               class StackResolver
 // -----------------------------------------------------------------------------
 
 namespace debugging {
+  struct Addr2LineProcess;
+
   class StackResolver {
 
 // -----------------------------------------------------------------------------
@@ -36,10 +42,77 @@ namespace debugging {
     public:
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief captures a stacktrace
+/// @brief sets the method used for capturing stacktraces
+////////////////////////////////////////////////////////////////////////////////
+
+      static void SetUnwinder (Configuration::UnwinderType);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sets the method used for resolving stacktraces
+////////////////////////////////////////////////////////////////////////////////
+
+      static void SetSymbolizer (Configuration::SymbolizerType);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief makes captureStackTrace() reuse the stacktraces of known call sites
+/// one in sample stacktraces of known call sites is still captured fully
+////////////////////////////////////////////////////////////////////////////////
+
+      static void UseCallSites (int);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief restricts tracing to allocations from the given modules
+////////////////////////////////////////////////////////////////////////////////
+
+      static void SetTracedModules (char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief rebuilds the table of loaded modules after modules were unloaded
+////////////////////////////////////////////////////////////////////////////////
+
+      static void RefreshModules ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the caller of louse is in one of the traced modules
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool IsTracedCaller ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief stores the caller of louse in the stack depot
+/// returns the id of a stacktrace with only the caller, or 0 on failure
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint32_t captureCaller ();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief formats the fingerprint of a leak for the given caller and size
+/// returns the length of the fingerprint, or 0 on failure
+////////////////////////////////////////////////////////////////////////////////
+
+      static size_t FormatFingerprint (void*, size_t, char*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief loads leak fingerprints written by a previous run
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool LoadFingerprints (char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the caller of louse and the size of its allocation
+/// match one of the fingerprints loaded
 ////////////////////////////////////////////////////////////////////////////////
 
-      static void** captureStackTrace (int);
+      static bool IsFingerprinted (size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief captures a stacktrace and stores it in the stack depot
+/// returns the id of the stacktrace in the depot, or 0 on failure. with
+/// call sites in use, the stacktrace may be the one of a previous call from
+/// the same call site
+////////////////////////////////////////////////////////////////////////////////
+
+      static uint32_t captureStackTrace (int);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief captures a stacktrace
@@ -53,6 +126,14 @@ namespace debugging {
 
       char* resolveStack (int, bool, char*, size_t, void**);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves the code addresses of several stacktraces up front, using
+/// up to the given number of threads. the texts are cached for use by
+/// resolveStack(), which produces the same output as without threads
+////////////////////////////////////////////////////////////////////////////////
+
+      void resolveStacks (int, bool, void** const*, size_t, int);
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                   private methods
 // -----------------------------------------------------------------------------
@@ -60,10 +141,72 @@ namespace debugging {
     private:
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief calls addr2line 
+/// @brief determines the file containing a code address, and the address
+/// the file is loaded at. the base address is a nullptr if it is unknown
+////////////////////////////////////////////////////////////////////////////////
+
+      void locateAddress (void*, char const**, void**);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a code address in the given file, which is loaded at the
+/// given base address
+////////////////////////////////////////////////////////////////////////////////
+
+      char* resolveAddress (bool, char const*, void*, void*, char**);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief stores the resolved text for a code address in the cache
 ////////////////////////////////////////////////////////////////////////////////
 
-      char* addr2line (bool, char const*, void*, char**);
+      void cacheLine (void*, char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves all addresses of a stacktrace that are not yet cached
+/// via addr2line. the addresses are written to the addr2line processes 
+/// before any result is read, so the processes work in parallel with louse
+////////////////////////////////////////////////////////////////////////////////
+
+      void resolveBatch (int, bool, void**);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a range of code addresses into the cache. this is run by
+/// the worker threads of resolveStacks(), each with a resolver of its own
+////////////////////////////////////////////////////////////////////////////////
+
+      void resolveAddresses (bool, void**, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief returns the addr2line process for a file, starting it if required
+/// returns a nullptr if the process cannot be started or has failed
+////////////////////////////////////////////////////////////////////////////////
+
+      Addr2LineProcess* addr2lineProcess (char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes a code address to an addr2line process
+////////////////////////////////////////////////////////////////////////////////
+
+      bool requestAddress (Addr2LineProcess*, char const*, void*, void*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the result for the next address from an addr2line process
+/// and adds it to the symbol cache
+////////////////////////////////////////////////////////////////////////////////
+
+      char* readAddress (bool, Addr2LineProcess*, void*, char**);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resolves a code address via addr2line
+////////////////////////////////////////////////////////////////////////////////
+
+      char* addr2line (bool, char const*, void*, void*, char**);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief appends the output of addr2line for an address, formatted as a
+/// line of a stacktrace
+////////////////////////////////////////////////////////////////////////////////
+
+      char* formatLine (bool, char*, size_t, char**);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief determines the name of the executable
@@ -95,7 +238,14 @@ namespace debugging {
 /// @brief resolved functions cache
 ////////////////////////////////////////////////////////////////////////////////
 
-      std::unordered_map<void*, char*>   cache_;
+      std::unordered_map<void*, char*, std::hash<void*>, std::equal_to<void*>,
+                         ArenaAllocator<std::pair<void* const, char*>>> cache_;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief running addr2line processes, one per file
+////////////////////////////////////////////////////////////////////////////////
+
+      Addr2LineProcess*                  processes_;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief buffer for executable name
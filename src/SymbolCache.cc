@@ -0,0 +1,640 @@
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <functional>
+#include <link.h>
+#include <mutex>
+#include <new>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Arena.h"
+#include "SymbolCache.h"
+
+using Arena       = debugging::Arena;
+using SymbolCache = debugging::SymbolCache;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                     private types
+// -----------------------------------------------------------------------------
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum length of a build-id in bytes
+////////////////////////////////////////////////////////////////////////////////
+
+  size_t const MaxBuildIdLength = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief header at the start of each cache file
+////////////////////////////////////////////////////////////////////////////////
+
+  struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a record of a cache file, followed by its text
+/// records start at multiples of 8 bytes
+////////////////////////////////////////////////////////////////////////////////
+
+  struct CacheRecord {
+    uint64_t offset;   // code address relative to the module's load address
+    uint32_t length;   // length of the text, without a null byte
+    uint32_t checksum; // of offset and text, detects partially written records
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the cache file of a module
+////////////////////////////////////////////////////////////////////////////////
+
+  struct CacheFile {
+    CacheFile*  next;
+    char        buildId[2 * MaxBuildIdLength + 1];
+    char const* data;     // nullptr if not mapped
+    size_t      size;
+    bool        writable; // false if the file has foreign contents
+
+    std::unordered_map<uint64_t, CacheRecord const*, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       debugging::ArenaAllocator<std::pair<uint64_t const, CacheRecord const*>>> index;
+
+    // offsets of the records not yet written
+    std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       debugging::ArenaAllocator<uint64_t>> stored;
+
+    // records not yet written
+    std::vector<char, debugging::ArenaAllocator<char>> pending;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief state for finding the module containing a code address
+////////////////////////////////////////////////////////////////////////////////
+
+  struct ModuleLookup {
+    uintptr_t pc;
+    uint64_t  offset;
+    bool      found;
+    char      buildId[2 * MaxBuildIdLength + 1]; // empty if there is none
+  };
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief magic bytes and version of the cache file format
+////////////////////////////////////////////////////////////////////////////////
+
+static char const Magic[8] = { 'L', 'O', 'U', 'S', 'E', 'S', 'Y', 'M' };
+
+static uint32_t const Version = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the cache directory, nullptr if the cache is not used
+////////////////////////////////////////////////////////////////////////////////
+
+static char const* Directory = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief list of all cache files opened so far
+////////////////////////////////////////////////////////////////////////////////
+
+static CacheFile* Files = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief protects the list of files and their contents
+////////////////////////////////////////////////////////////////////////////////
+
+static std::mutex FilesLock;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private helper functions
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief rounds a record size up to a multiple of 8 bytes
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t RecordSize (uint32_t length) {
+  return (sizeof(CacheRecord) + length + 7) & ~static_cast<size_t>(7);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief computes the checksum of a record, FNV-1a over offset and text
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t Checksum (uint64_t offset, char const* text, uint32_t length) {
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < sizeof(offset); ++i) {
+    hash ^= static_cast<uint8_t>(offset >> (i * 8));
+    hash *= 16777619U;
+  }
+
+  for (uint32_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(text[i]);
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the end of the last intact record of a cache file
+/// a record cut short by a writer that died, and everything behind it, is
+/// not part of the file's contents
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t ValidSize (char const* data, size_t size) {
+  size_t position = sizeof(CacheHeader);
+
+  while (position + sizeof(CacheRecord) <= size) {
+    auto record = reinterpret_cast<CacheRecord const*>(data + position);
+    auto text = reinterpret_cast<char const*>(record + 1);
+
+    if (record->length > size - position - sizeof(CacheRecord) ||
+        RecordSize(record->length) > size - position ||
+        record->checksum != Checksum(record->offset, text, record->length)) {
+      break;
+    }
+
+    position += RecordSize(record->length);
+  }
+
+  return position;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the name of the cache file for a build-id
+////////////////////////////////////////////////////////////////////////////////
+
+static bool CacheFileName (char const* buildId, char* buffer, size_t length) {
+  int written = ::snprintf(buffer, length, "%s/%s.sym", Directory, buildId);
+
+  return (written > 0 && static_cast<size_t>(written) < length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes data to a file completely
+////////////////////////////////////////////////////////////////////////////////
+
+static bool WriteAll (int fd, char const* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    data += n;
+    length -= static_cast<size_t>(n);
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the build-id of a module from its note segments in memory
+////////////////////////////////////////////////////////////////////////////////
+
+static void ReadBuildId (struct dl_phdr_info* info, char* buildId) {
+  char const* hex = "0123456789abcdef";
+
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    ElfW(Phdr) const& phdr = info->dlpi_phdr[i];
+
+    if (phdr.p_type != PT_NOTE) {
+      continue;
+    }
+
+    size_t const align = (phdr.p_align == 8) ? 8 : 4;
+    char const* note = reinterpret_cast<char const*>(info->dlpi_addr + phdr.p_vaddr);
+    char const* end = note + phdr.p_memsz;
+
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      auto header = reinterpret_cast<ElfW(Nhdr) const*>(note);
+      char const* name = note + sizeof(ElfW(Nhdr));
+      char const* desc = name + ((header->n_namesz + align - 1) & ~(align - 1));
+
+      if (desc + header->n_descsz > end) {
+        break;
+      }
+
+      if (header->n_type == NT_GNU_BUILD_ID &&
+          header->n_namesz == 4 &&
+          ::memcmp(name, "GNU", 4) == 0 &&
+          header->n_descsz > 0 &&
+          header->n_descsz <= MaxBuildIdLength) {
+        auto id = reinterpret_cast<unsigned char const*>(desc);
+
+        for (size_t j = 0; j < header->n_descsz; ++j) {
+          *buildId++ = hex[id[j] >> 4];
+          *buildId++ = hex[id[j] & 0xf];
+        }
+
+        *buildId = '\0';
+        return;
+      }
+
+      note = desc + ((header->n_descsz + align - 1) & ~(align - 1));
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief callback for dl_iterate_phdr that finds the module containing a
+/// code address
+////////////////////////////////////////////////////////////////////////////////
+
+static int FindModule (struct dl_phdr_info* info, size_t, void* data) {
+  auto lookup = static_cast<ModuleLookup*>(data);
+
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    ElfW(Phdr) const& phdr = info->dlpi_phdr[i];
+
+    if (phdr.p_type != PT_LOAD) {
+      continue;
+    }
+
+    uintptr_t const start = info->dlpi_addr + phdr.p_vaddr;
+
+    if (lookup->pc >= start && lookup->pc < start + phdr.p_memsz) {
+      lookup->found  = true;
+      lookup->offset = lookup->pc - info->dlpi_addr;
+      ReadBuildId(info, &lookup->buildId[0]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the build-id of the module containing a code address,
+/// and the offset of the address in the module
+////////////////////////////////////////////////////////////////////////////////
+
+static bool LocateAddress (void const* pc, ModuleLookup& lookup) {
+  lookup.pc         = reinterpret_cast<uintptr_t>(pc);
+  lookup.offset     = 0;
+  lookup.found      = false;
+  lookup.buildId[0] = '\0';
+
+  ::dl_iterate_phdr(FindModule, &lookup);
+
+  return (lookup.found && lookup.buildId[0] != '\0');
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maps a cache file and indexes its records
+/// a shared lock keeps writers out while the records are read, so a record
+/// being written is never seen. the records found remain valid, as writers
+/// only append to the file, or cut off a partially written record at its
+/// end. the lock must be released explicitly, as the mapping keeps the file
+/// open
+////////////////////////////////////////////////////////////////////////////////
+
+static void MapFile (CacheFile* file) {
+  char path[4096];
+
+  if (! CacheFileName(file->buildId, &path[0], sizeof(path))) {
+    file->writable = false;
+    return;
+  }
+
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    // not cached yet
+    return;
+  }
+
+  ::flock(fd, LOCK_SH);
+
+  struct stat info;
+
+  if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return;
+  }
+
+  size_t const size = static_cast<size_t>(info.st_size);
+
+  if (size < sizeof(CacheHeader)) {
+    file->writable = false;
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return;
+  }
+
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED) {
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return;
+  }
+
+  auto header = static_cast<CacheHeader const*>(data);
+
+  if (::memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+      header->version != Version) {
+    file->writable = false;
+    ::munmap(data, size);
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return;
+  }
+
+  file->data = static_cast<char const*>(data);
+  file->size = size;
+
+  size_t const valid = ValidSize(file->data, size);
+  size_t position = sizeof(CacheHeader);
+
+  try {
+    while (position < valid) {
+      auto record = reinterpret_cast<CacheRecord const*>(file->data + position);
+
+      file->index.emplace(record->offset, record);
+      position += RecordSize(record->length);
+    }
+  }
+  catch (...) {
+    // out of arena memory. use what was indexed so far
+  }
+
+  ::flock(fd, LOCK_UN);
+  ::close(fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief returns the cache file for a build-id, mapping it if required
+/// must be called with the files lock held
+////////////////////////////////////////////////////////////////////////////////
+
+static CacheFile* GetFile (char const* buildId) {
+  CacheFile* file = Files;
+
+  while (file != nullptr) {
+    if (::strcmp(file->buildId, buildId) == 0) {
+      return file;
+    }
+    file = file->next;
+  }
+
+  void* memory = Arena::Allocate(sizeof(CacheFile));
+
+  if (memory == nullptr) {
+    return nullptr;
+  }
+
+  file = new (memory) CacheFile();
+  ::strcpy(file->buildId, buildId);
+  file->data     = nullptr;
+  file->size     = 0;
+  file->writable = true;
+
+  MapFile(file);
+
+  file->next = Files;
+  Files = file;
+
+  return file;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief checks the header of a cache file, and cuts off a partially written
+/// record at its end. must be called with an exclusive lock on the file.
+/// the size is updated to the new size of the file. returns false if the
+/// file has foreign contents
+////////////////////////////////////////////////////////////////////////////////
+
+static bool TruncateFile (int fd, off_t& size) {
+  size_t const length = static_cast<size_t>(size);
+
+  if (length < sizeof(CacheHeader)) {
+    return false;
+  }
+
+  void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  auto header = static_cast<CacheHeader const*>(data);
+  bool valid = (::memcmp(header->magic, Magic, sizeof(Magic)) == 0 &&
+                header->version == Version);
+  size_t const end = valid ? ValidSize(static_cast<char const*>(data), length) : length;
+
+  ::munmap(data, length);
+
+  if (valid && end < length) {
+    valid = (::ftruncate(fd, static_cast<off_t>(end)) == 0);
+
+    if (valid) {
+      size = static_cast<off_t>(end);
+    }
+  }
+
+  return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief appends the records not yet written to a cache file
+/// an exclusive lock serializes concurrent writers. a partially written
+/// record, left behind by a writer that failed or died, is cut off before
+/// appending, so that later records are not lost behind it
+////////////////////////////////////////////////////////////////////////////////
+
+static void WriteFile (CacheFile const* file) {
+  char path[4096];
+
+  if (! CacheFileName(file->buildId, &path[0], sizeof(path))) {
+    return;
+  }
+
+  int fd = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+
+  if (fd < 0) {
+    return;
+  }
+
+  if (::flock(fd, LOCK_EX) != 0) {
+    ::close(fd);
+    return;
+  }
+
+  struct stat info;
+
+  if (::fstat(fd, &info) == 0) {
+    off_t size = info.st_size;
+    bool valid;
+
+    if (size == 0) {
+      CacheHeader header;
+      ::memset(&header, 0, sizeof(header));
+      ::memcpy(header.magic, Magic, sizeof(Magic));
+      header.version = Version;
+
+      valid = WriteAll(fd, reinterpret_cast<char const*>(&header), sizeof(header));
+    }
+    else {
+      // the file may have been created by another process in the meantime
+      valid = TruncateFile(fd, size);
+    }
+
+    if (valid && ! WriteAll(fd, file->pending.data(), file->pending.size())) {
+      valid = false;
+    }
+
+    if (! valid && ::ftruncate(fd, size) != 0) {
+      // nothing else can be done
+    }
+  }
+
+  ::close(fd);
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 class SymbolCache
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sets the cache directory. a nullptr turns the cache off
+////////////////////////////////////////////////////////////////////////////////
+
+void SymbolCache::SetDirectory (char const* directory) {
+  Directory = directory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief looks up the symbolized text of a code address
+////////////////////////////////////////////////////////////////////////////////
+
+bool SymbolCache::Lookup (void const* pc, char* buffer, size_t length) {
+  ModuleLookup lookup;
+
+  if (Directory == nullptr || ! LocateAddress(pc, lookup)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> locker(FilesLock);
+
+  CacheFile* file = GetFile(lookup.buildId);
+
+  if (file == nullptr) {
+    return false;
+  }
+
+  auto it = file->index.find(lookup.offset);
+
+  if (it == file->index.end() || (*it).second->length >= length) {
+    return false;
+  }
+
+  CacheRecord const* record = (*it).second;
+  ::memcpy(buffer, record + 1, record->length);
+  buffer[record->length] = '\0';
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief adds the symbolized text of a code address to the cache
+////////////////////////////////////////////////////////////////////////////////
+
+void SymbolCache::Store (void const* pc, char const* text) {
+  ModuleLookup lookup;
+
+  if (Directory == nullptr || ! LocateAddress(pc, lookup)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> locker(FilesLock);
+
+  CacheFile* file = GetFile(lookup.buildId);
+
+  if (file == nullptr || ! file->writable ||
+      file->index.find(lookup.offset) != file->index.end()) {
+    return;
+  }
+
+  CacheRecord record;
+  record.offset   = lookup.offset;
+  record.length   = static_cast<uint32_t>(::strlen(text));
+  record.checksum = Checksum(record.offset, text, record.length);
+
+  size_t const size = RecordSize(record.length);
+  size_t const start = file->pending.size();
+
+  try {
+    // reserve first, so that no partial record is left behind
+    file->pending.reserve(start + size);
+
+    if (! file->stored.emplace(record.offset).second) {
+      return;
+    }
+  }
+  catch (...) {
+    return;
+  }
+
+  auto bytes = reinterpret_cast<char const*>(&record);
+  file->pending.insert(file->pending.end(), bytes, bytes + sizeof(record));
+  file->pending.insert(file->pending.end(), text, text + record.length);
+  file->pending.resize(start + size, '\0');
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes the texts added to the cache files, and unmaps all files
+////////////////////////////////////////////////////////////////////////////////
+
+void SymbolCache::Release () {
+  std::lock_guard<std::mutex> locker(FilesLock);
+
+  bool created = false;
+
+  while (Files != nullptr) {
+    CacheFile* file = Files;
+    Files = file->next;
+
+    if (file->writable && ! file->pending.empty()) {
+      if (! created) {
+        // the directory may exist already
+        ::mkdir(Directory, 0777);
+        created = true;
+      }
+
+      WriteFile(file);
+    }
+
+    if (file->data != nullptr) {
+      ::munmap(const_cast<char*>(file->data), file->size);
+    }
+
+    file->~CacheFile();
+    Arena::Free(file, sizeof(CacheFile));
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef LOUSE_SYMBOLCACHE_H
+#define LOUSE_SYMBOLCACHE_H 1
+
+#include <cstdlib>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 class SymbolCache
+// -----------------------------------------------------------------------------
+
+namespace debugging {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief persistent cache of symbolized code addresses
+/// the cache directory holds one file per executable or shared library, named
+/// after the module's ELF build-id. each file is a list of records with the
+/// offset of a code address in the module and its symbolized text. the files
+/// are memory-mapped for lookups, and new records are appended when louse
+/// shuts down, under an exclusive file lock so that concurrent processes can
+/// share a cache directory. modules without a build-id are not cached
+////////////////////////////////////////////////////////////////////////////////
+
+  class SymbolCache {
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+    private:
+
+      SymbolCache () = delete;
+
+      ~SymbolCache () = delete;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sets the cache directory. a nullptr turns the cache off
+////////////////////////////////////////////////////////////////////////////////
+
+      static void SetDirectory (char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief looks up the symbolized text of a code address, in the format
+/// produced by Symbolizer::Symbolize(). returns false if it is not cached
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool Lookup (void const*, char*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief adds the symbolized text of a code address to the cache. the text
+/// is written to the cache file by Release()
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Store (void const*, char const*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief writes the texts added to the cache files, and unmaps all files
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Release ();
+  };
+}
+
+#endif
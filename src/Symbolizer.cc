@@ -0,0 +1,1052 @@
+
+#include <algorithm>
+#include <cstring>
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Arena.h"
+#include "Symbolizer.h"
+
+using Arena      = debugging::Arena;
+using Symbolizer = debugging::Symbolizer;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                     private types
+// -----------------------------------------------------------------------------
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief vector that allocates from the arena
+////////////////////////////////////////////////////////////////////////////////
+
+  template<typename T> using ArenaVector = std::vector<T, debugging::ArenaAllocator<T>>;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a file mapped into memory
+////////////////////////////////////////////////////////////////////////////////
+
+  struct MappedFile {
+    char const* data; // nullptr if not mapped
+    size_t      size;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the contents of an ELF section
+////////////////////////////////////////////////////////////////////////////////
+
+  struct Section {
+    char const* data; // nullptr if the section is not present
+    size_t      size;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a function symbol
+////////////////////////////////////////////////////////////////////////////////
+
+  struct Symbol {
+    uintptr_t   address;
+    uintptr_t   size;
+    char const* name;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a row of a line number table
+/// rows with file EndOfSequence end a sequence of code addresses
+////////////////////////////////////////////////////////////////////////////////
+
+  struct LineRow {
+    uintptr_t address;
+    uint32_t  file;
+    uint32_t  line;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief a file name of a line number table
+////////////////////////////////////////////////////////////////////////////////
+
+  struct FileName {
+    char const* base;      // compilation directory for relative directories
+    char const* directory; // nullptr if unknown
+    char const* name;
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the symbol tables of an executable or shared library
+////////////////////////////////////////////////////////////////////////////////
+
+  struct SymbolFile {
+    SymbolFile*           next;
+    char*                 path;
+    MappedFile            image;
+    MappedFile            debugImage;   // separate debug information
+    uintptr_t             firstAddress; // address of the first mapped page
+    ArenaVector<Symbol>   symbols;
+    ArenaVector<LineRow>  lines;
+    ArenaVector<FileName> files;
+    std::once_flag        loaded;       // tables are loaded once, unlocked
+  };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sequential reader for DWARF data
+/// reading beyond the end sets the failed flag and returns zeros
+////////////////////////////////////////////////////////////////////////////////
+
+  struct Reader {
+    Reader (char const* data, char const* end)
+      : data(data), end(end), failed(false) {
+    }
+
+    bool has (size_t n) {
+      if (failed || static_cast<size_t>(end - data) < n) {
+        failed = true;
+        return false;
+      }
+      return true;
+    }
+
+    void skip (size_t n) {
+      if (has(n)) {
+        data += n;
+      }
+    }
+
+    uint64_t fixed (size_t n) {
+      uint64_t value = 0;
+
+      if (has(n)) {
+        // DWARF data is in the byte order of the target
+        ::memcpy(&value, data, n);
+        data += n;
+      }
+      return value;
+    }
+
+    uint64_t uleb () {
+      uint64_t value = 0;
+      unsigned shift = 0;
+
+      while (has(1)) {
+        uint8_t byte = static_cast<uint8_t>(*data++);
+
+        if (shift < 64) {
+          value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        }
+        shift += 7;
+
+        if ((byte & 0x80) == 0) {
+          break;
+        }
+      }
+      return value;
+    }
+
+    int64_t sleb () {
+      int64_t value = 0;
+      unsigned shift = 0;
+      uint8_t byte = 0;
+
+      while (has(1)) {
+        byte = static_cast<uint8_t>(*data++);
+
+        if (shift < 64) {
+          value |= static_cast<int64_t>(byte & 0x7f) << shift;
+        }
+        shift += 7;
+
+        if ((byte & 0x80) == 0) {
+          break;
+        }
+      }
+
+      if (shift < 64 && (byte & 0x40) != 0) {
+        value |= -(static_cast<int64_t>(1) << shift);
+      }
+      return value;
+    }
+
+    char const* string () {
+      char const* start = data;
+      void const* terminator = failed ? nullptr : ::memchr(data, '\0', end - data);
+
+      if (terminator == nullptr) {
+        failed = true;
+        return "";
+      }
+
+      data = static_cast<char const*>(terminator) + 1;
+      return start;
+    }
+
+    char const* data;
+    char const* end;
+    bool        failed;
+  };
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                 private variables
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief file index of rows that end a sequence
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t const EndOfSequence = UINT32_MAX;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief DWARF constants used by line number programs
+////////////////////////////////////////////////////////////////////////////////
+
+enum {
+  DW_LNS_copy               = 0x01,
+  DW_LNS_advance_pc         = 0x02,
+  DW_LNS_advance_line       = 0x03,
+  DW_LNS_set_file           = 0x04,
+  DW_LNS_const_add_pc       = 0x08,
+  DW_LNS_fixed_advance_pc   = 0x09,
+  DW_LNE_end_sequence       = 0x01,
+  DW_LNE_set_address        = 0x02,
+  DW_LNCT_path              = 0x01,
+  DW_LNCT_directory_index   = 0x02,
+  DW_FORM_block2            = 0x03,
+  DW_FORM_block4            = 0x04,
+  DW_FORM_data2             = 0x05,
+  DW_FORM_data4             = 0x06,
+  DW_FORM_data8             = 0x07,
+  DW_FORM_string            = 0x08,
+  DW_FORM_block             = 0x09,
+  DW_FORM_block1            = 0x0a,
+  DW_FORM_data1             = 0x0b,
+  DW_FORM_sdata             = 0x0d,
+  DW_FORM_strp              = 0x0e,
+  DW_FORM_udata             = 0x0f,
+  DW_FORM_data16            = 0x1e,
+  DW_FORM_line_strp         = 0x1f
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief list of all files loaded so far
+////////////////////////////////////////////////////////////////////////////////
+
+static SymbolFile* Files = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief protects the list of files. the tables of a file are not changed
+/// once they are loaded, so lookups need no lock
+////////////////////////////////////////////////////////////////////////////////
+
+static std::mutex FilesLock;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private helper functions
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maps an ELF file into memory
+////////////////////////////////////////////////////////////////////////////////
+
+static bool MapFile (char const* path, MappedFile& file) {
+  file.data = nullptr;
+  file.size = 0;
+
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+
+  if (::fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(ElfW(Ehdr))) {
+    ::close(fd);
+    return false;
+  }
+
+  void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  auto header = static_cast<ElfW(Ehdr) const*>(data);
+
+  if (::memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+      header->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+      header->e_shentsize != sizeof(ElfW(Shdr)) ||
+      header->e_shoff + header->e_shnum * sizeof(ElfW(Shdr)) > static_cast<size_t>(info.st_size) ||
+      header->e_shstrndx >= header->e_shnum) {
+    ::munmap(data, info.st_size);
+    return false;
+  }
+
+  file.data = static_cast<char const*>(data);
+  file.size = static_cast<size_t>(info.st_size);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief looks up a section of a mapped ELF file by name
+/// compressed sections are treated as missing, and left to addr2line
+////////////////////////////////////////////////////////////////////////////////
+
+static Section FindSection (MappedFile const& file, char const* name) {
+  Section result = { nullptr, 0 };
+
+  if (file.data == nullptr) {
+    return result;
+  }
+
+  auto header   = reinterpret_cast<ElfW(Ehdr) const*>(file.data);
+  auto sections = reinterpret_cast<ElfW(Shdr) const*>(file.data + header->e_shoff);
+  auto names    = sections[header->e_shstrndx];
+
+  if (names.sh_offset + names.sh_size > file.size) {
+    return result;
+  }
+
+  for (size_t i = 0; i < header->e_shnum; ++i) {
+    auto const& section = sections[i];
+
+    if (section.sh_name >= names.sh_size ||
+        ::strncmp(file.data + names.sh_offset + section.sh_name, name, names.sh_size - section.sh_name) != 0) {
+      continue;
+    }
+
+    if (section.sh_type == SHT_NOBITS ||
+        (section.sh_flags & SHF_COMPRESSED) != 0 ||
+        section.sh_offset + section.sh_size > file.size) {
+      break;
+    }
+
+    result.data = file.data + section.sh_offset;
+    result.size = section.sh_size;
+    break;
+  }
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the address of the first page an ELF file maps
+////////////////////////////////////////////////////////////////////////////////
+
+static uintptr_t FirstAddress (MappedFile const& file) {
+  auto header = reinterpret_cast<ElfW(Ehdr) const*>(file.data);
+
+  if (header->e_phentsize != sizeof(ElfW(Phdr)) ||
+      header->e_phoff + header->e_phnum * sizeof(ElfW(Phdr)) > file.size) {
+    return 0;
+  }
+
+  auto segments = reinterpret_cast<ElfW(Phdr) const*>(file.data + header->e_phoff);
+  uintptr_t first = UINTPTR_MAX;
+
+  for (size_t i = 0; i < header->e_phnum; ++i) {
+    if (segments[i].p_type == PT_LOAD && segments[i].p_vaddr < first) {
+      first = segments[i].p_vaddr;
+    }
+  }
+
+  if (first == UINTPTR_MAX) {
+    return 0;
+  }
+
+  // the dynamic linker maps whole pages
+  return first & ~(static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE)) - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief determines the name of the separate debug file for an ELF file
+/// returns false if the file has no build id
+////////////////////////////////////////////////////////////////////////////////
+
+static bool DebugFileName (MappedFile const& file, char* buffer, size_t length) {
+  Section note = FindSection(file, ".note.gnu.build-id");
+
+  if (note.data == nullptr || note.size < sizeof(ElfW(Nhdr))) {
+    return false;
+  }
+
+  auto header = reinterpret_cast<ElfW(Nhdr) const*>(note.data);
+  size_t const nameSize = (header->n_namesz + 3) & ~3;
+
+  if (header->n_type != NT_GNU_BUILD_ID ||
+      header->n_descsz < 2 ||
+      sizeof(ElfW(Nhdr)) + nameSize + header->n_descsz > note.size) {
+    return false;
+  }
+
+  auto id = reinterpret_cast<unsigned char const*>(note.data + sizeof(ElfW(Nhdr)) + nameSize);
+  char const* prefix = "/usr/lib/debug/.build-id/";
+  size_t const prefixLength = ::strlen(prefix);
+
+  if (prefixLength + 2 * header->n_descsz + 8 > length) {
+    return false;
+  }
+
+  char const* hex = "0123456789abcdef";
+  char* p = buffer;
+
+  ::memcpy(p, prefix, prefixLength);
+  p += prefixLength;
+
+  for (size_t i = 0; i < header->n_descsz; ++i) {
+    *p++ = hex[id[i] >> 4];
+    *p++ = hex[id[i] & 0xf];
+
+    if (i == 0) {
+      *p++ = '/';
+    }
+  }
+
+  ::memcpy(p, ".debug", 7);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief adds the function symbols of a symbol table
+////////////////////////////////////////////////////////////////////////////////
+
+static void LoadSymbols (SymbolFile* file, MappedFile const& image, char const* table, char const* names) {
+  Section symbols = FindSection(image, table);
+  Section strings = FindSection(image, names);
+
+  if (symbols.data == nullptr || strings.data == nullptr) {
+    return;
+  }
+
+  auto symbol = reinterpret_cast<ElfW(Sym) const*>(symbols.data);
+  size_t const n = symbols.size / sizeof(ElfW(Sym));
+
+  for (size_t i = 0; i < n; ++i, ++symbol) {
+    int const type = ELF64_ST_TYPE(symbol->st_info);
+
+    if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+        symbol->st_shndx == SHN_UNDEF ||
+        symbol->st_value == 0 ||
+        symbol->st_name >= strings.size) {
+      continue;
+    }
+
+    file->symbols.push_back(Symbol{ static_cast<uintptr_t>(symbol->st_value),
+                                    static_cast<uintptr_t>(symbol->st_size),
+                                    strings.data + symbol->st_name });
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads an attribute of a file or directory entry in a DWARF 5 line
+/// number program header. returns the attribute's string, or a nullptr for
+/// attributes that are not strings
+////////////////////////////////////////////////////////////////////////////////
+
+static char const* ReadEntryAttribute (Reader& reader, uint64_t form, bool is64,
+                                       Section const& strings, Section const& lineStrings,
+                                       uint64_t& value) {
+  value = 0;
+
+  switch (form) {
+    case DW_FORM_string:
+      return reader.string();
+    case DW_FORM_strp:
+    case DW_FORM_line_strp: {
+      Section const& section = (form == DW_FORM_strp) ? strings : lineStrings;
+      uint64_t offset = reader.fixed(is64 ? 8 : 4);
+
+      if (section.data == nullptr || offset >= section.size) {
+        return "";
+      }
+      return section.data + offset;
+    }
+    case DW_FORM_data1:
+      value = reader.fixed(1);
+      return nullptr;
+    case DW_FORM_data2:
+      value = reader.fixed(2);
+      return nullptr;
+    case DW_FORM_data4:
+      value = reader.fixed(4);
+      return nullptr;
+    case DW_FORM_data8:
+      value = reader.fixed(8);
+      return nullptr;
+    case DW_FORM_udata:
+      value = reader.uleb();
+      return nullptr;
+    case DW_FORM_sdata:
+      reader.sleb();
+      return nullptr;
+    case DW_FORM_data16:
+      reader.skip(16);
+      return nullptr;
+    case DW_FORM_block1:
+      reader.skip(reader.fixed(1));
+      return nullptr;
+    case DW_FORM_block2:
+      reader.skip(reader.fixed(2));
+      return nullptr;
+    case DW_FORM_block4:
+      reader.skip(reader.fixed(4));
+      return nullptr;
+    case DW_FORM_block:
+      reader.skip(reader.uleb());
+      return nullptr;
+  }
+
+  // a form that cannot appear here
+  reader.failed = true;
+  return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief reads the directory or file name entries of a DWARF 5 line number
+/// program header
+////////////////////////////////////////////////////////////////////////////////
+
+static void ReadEntries (Reader& reader, bool is64, Section const& strings, Section const& lineStrings,
+                         ArenaVector<char const*> const& directories, ArenaVector<FileName>& entries) {
+  uint64_t formats[16][2];
+  size_t numFormats = reader.fixed(1);
+
+  if (numFormats > sizeof(formats) / sizeof(formats[0])) {
+    reader.failed = true;
+    return;
+  }
+
+  for (size_t i = 0; i < numFormats; ++i) {
+    formats[i][0] = reader.uleb();
+    formats[i][1] = reader.uleb();
+  }
+
+  uint64_t count = reader.uleb();
+
+  for (uint64_t i = 0; i < count && ! reader.failed; ++i) {
+    FileName entry = { nullptr, nullptr, "" };
+
+    for (size_t j = 0; j < numFormats; ++j) {
+      uint64_t value;
+      char const* s = ReadEntryAttribute(reader, formats[j][1], is64, strings, lineStrings, value);
+
+      if (formats[j][0] == DW_LNCT_path && s != nullptr) {
+        entry.name = s;
+      }
+      else if (formats[j][0] == DW_LNCT_directory_index && value < directories.size()) {
+        entry.directory = directories[value];
+
+        if (value > 0 && entry.directory[0] != '/') {
+          // directory 0 is the compilation directory
+          entry.base = directories[0];
+        }
+      }
+    }
+
+    entries.push_back(entry);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief decodes the line number programs of all compilation units
+////////////////////////////////////////////////////////////////////////////////
+
+static void LoadLines (SymbolFile* file, MappedFile const& image) {
+  Section lines       = FindSection(image, ".debug_line");
+  Section strings     = FindSection(image, ".debug_str");
+  Section lineStrings = FindSection(image, ".debug_line_str");
+
+  if (lines.data == nullptr) {
+    return;
+  }
+
+  Reader reader(lines.data, lines.data + lines.size);
+
+  while (reader.data < reader.end && ! reader.failed) {
+    bool is64 = false;
+    uint64_t unitLength = reader.fixed(4);
+
+    if (unitLength == 0xffffffff) {
+      is64 = true;
+      unitLength = reader.fixed(8);
+    }
+
+    if (reader.failed || unitLength > static_cast<uint64_t>(reader.end - reader.data)) {
+      break;
+    }
+
+    char const* unitEnd = reader.data + unitLength;
+    Reader unit(reader.data, unitEnd);
+    reader.data = unitEnd;
+
+    uint16_t const version = unit.fixed(2);
+
+    if (version < 2 || version > 5) {
+      continue;
+    }
+
+    size_t addressSize = sizeof(void*);
+
+    if (version >= 5) {
+      addressSize = unit.fixed(1);
+      unit.fixed(1); // segment selector size
+    }
+
+    uint64_t const headerLength = unit.fixed(is64 ? 8 : 4);
+
+    if (unit.failed || headerLength > static_cast<uint64_t>(unitEnd - unit.data)) {
+      continue;
+    }
+
+    char const* program = unit.data + headerLength;
+
+    uint8_t const minLength = unit.fixed(1);
+
+    if (version >= 4) {
+      unit.fixed(1); // maximum operations per instruction
+    }
+
+    unit.fixed(1); // default is_stmt
+    int8_t const lineBase    = static_cast<int8_t>(unit.fixed(1));
+    uint8_t const lineRange  = unit.fixed(1);
+    uint8_t const opcodeBase = unit.fixed(1);
+    uint8_t const* opcodeLengths = reinterpret_cast<uint8_t const*>(unit.data);
+
+    unit.skip(opcodeBase > 0 ? opcodeBase - 1 : 0);
+
+    if (unit.failed || lineRange == 0 || opcodeBase == 0) {
+      continue;
+    }
+
+    // file indexes of the line number program are relative to this
+    size_t const fileBase = file->files.size();
+    ArenaVector<char const*> directories;
+
+    if (version >= 5) {
+      ArenaVector<FileName> entries;
+      ReadEntries(unit, is64, strings, lineStrings, directories, entries);
+
+      for (auto const& it : entries) {
+        directories.push_back(it.name);
+      }
+
+      ReadEntries(unit, is64, strings, lineStrings, directories, file->files);
+    }
+    else {
+      // directory 0 is the compilation directory, which is not recorded here
+      directories.push_back(nullptr);
+
+      while (true) {
+        char const* directory = unit.string();
+
+        if (unit.failed || *directory == '\0') {
+          break;
+        }
+        directories.push_back(directory);
+      }
+
+      // file indexes start at 1
+      file->files.push_back(FileName{ nullptr, nullptr, "" });
+
+      while (true) {
+        char const* name = unit.string();
+
+        if (unit.failed || *name == '\0') {
+          break;
+        }
+
+        uint64_t const directory = unit.uleb();
+        unit.uleb(); // modification time
+        unit.uleb(); // file size
+
+        file->files.push_back(FileName{ nullptr, directory < directories.size() ? directories[directory] : nullptr, name });
+      }
+    }
+
+    if (unit.failed) {
+      continue;
+    }
+
+    // run the line number program
+    unit.data = program;
+
+    uintptr_t address = 0;
+    uint64_t fileIndex = 1;
+    int64_t line = 1;
+    // sequences of code that the linker discarded start at address 0
+    bool discarded = false;
+
+    auto emit = [&] () {
+      if (! discarded && fileBase + fileIndex < file->files.size()) {
+        file->lines.push_back(LineRow{ address, static_cast<uint32_t>(fileBase + fileIndex), static_cast<uint32_t>(line) });
+      }
+    };
+
+    while (unit.data < unitEnd && ! unit.failed) {
+      uint8_t const opcode = unit.fixed(1);
+
+      if (opcode >= opcodeBase) {
+        // special opcode
+        uint8_t const adjusted = opcode - opcodeBase;
+        address += (adjusted / lineRange) * minLength;
+        line += lineBase + (adjusted % lineRange);
+        emit();
+        continue;
+      }
+
+      switch (opcode) {
+        case 0: {
+          // extended opcode
+          uint64_t const length = unit.uleb();
+
+          if (length == 0 || ! unit.has(length)) {
+            unit.failed = true;
+            break;
+          }
+
+          char const* next = unit.data + length;
+          uint8_t const extended = unit.fixed(1);
+
+          if (extended == DW_LNE_end_sequence) {
+            if (! discarded) {
+              file->lines.push_back(LineRow{ address, EndOfSequence, 0 });
+            }
+            address = 0;
+            fileIndex = 1;
+            line = 1;
+            discarded = false;
+          }
+          else if (extended == DW_LNE_set_address && length - 1 == addressSize) {
+            address = unit.fixed(addressSize);
+            discarded = (address == 0 || address >= static_cast<uintptr_t>(-2));
+          }
+
+          unit.data = next;
+          break;
+        }
+        case DW_LNS_copy:
+          emit();
+          break;
+        case DW_LNS_advance_pc:
+          address += unit.uleb() * minLength;
+          break;
+        case DW_LNS_advance_line:
+          line += unit.sleb();
+          break;
+        case DW_LNS_set_file:
+          fileIndex = unit.uleb();
+          break;
+        case DW_LNS_const_add_pc:
+          address += ((255 - opcodeBase) / lineRange) * minLength;
+          break;
+        case DW_LNS_fixed_advance_pc:
+          address += unit.fixed(2);
+          break;
+        default:
+          // skip the operands of all other standard opcodes
+          for (uint8_t i = 0; i < opcodeLengths[opcode - 1]; ++i) {
+            unit.uleb();
+          }
+          break;
+      }
+    }
+  }
+
+  // at the same address, a sequence's end comes before the next one's start
+  std::sort(file->lines.begin(), file->lines.end(), [] (LineRow const& lhs, LineRow const& rhs) {
+    if (lhs.address != rhs.address) {
+      return lhs.address < rhs.address;
+    }
+    return (lhs.file == EndOfSequence && rhs.file != EndOfSequence);
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief adds a file to the list of files, without loading its tables
+/// must be called with the files lock held
+////////////////////////////////////////////////////////////////////////////////
+
+static SymbolFile* AddFile (char const* path) {
+  void* memory = Arena::Allocate(sizeof(SymbolFile));
+  size_t const length = ::strlen(path);
+  char* copy = static_cast<char*>(Arena::Allocate(length + 1));
+
+  if (memory == nullptr || copy == nullptr) {
+    if (memory != nullptr) {
+      Arena::Free(memory, sizeof(SymbolFile));
+    }
+    if (copy != nullptr) {
+      Arena::Free(copy, length + 1);
+    }
+    return nullptr;
+  }
+
+  ::memcpy(copy, path, length + 1);
+
+  auto file = new (memory) SymbolFile();
+  file->path = copy;
+  file->image.data = nullptr;
+  file->debugImage.data = nullptr;
+  file->firstAddress = 0;
+
+  file->next = Files;
+  Files = file;
+
+  return file;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief loads the symbol tables of a file
+/// files that cannot be read are kept with empty tables, so they are tried
+/// only once
+////////////////////////////////////////////////////////////////////////////////
+
+static void LoadFile (SymbolFile* file) {
+  char const* path = file->path;
+
+  try {
+    if (MapFile(path, file->image)) {
+      file->firstAddress = FirstAddress(file->image);
+
+      char debugPath[256];
+
+      if (FindSection(file->image, ".debug_line").data == nullptr &&
+          DebugFileName(file->image, &debugPath[0], sizeof(debugPath))) {
+        MapFile(&debugPath[0], file->debugImage);
+      }
+
+      LoadSymbols(file, file->image, ".symtab", ".strtab");
+
+      if (file->symbols.empty()) {
+        LoadSymbols(file, file->debugImage, ".symtab", ".strtab");
+      }
+
+      if (file->symbols.empty()) {
+        LoadSymbols(file, file->image, ".dynsym", ".dynstr");
+      }
+
+      std::sort(file->symbols.begin(), file->symbols.end(), [] (Symbol const& lhs, Symbol const& rhs) {
+        return lhs.address < rhs.address;
+      });
+
+      LoadLines(file, file->debugImage.data != nullptr ? file->debugImage : file->image);
+    }
+  }
+  catch (...) {
+    // out of arena memory. use what was loaded so far
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief looks up the function symbol of an address
+////////////////////////////////////////////////////////////////////////////////
+
+static char const* FindFunction (SymbolFile const* file, uintptr_t address) {
+  auto it = std::upper_bound(file->symbols.begin(), file->symbols.end(), address, [] (uintptr_t value, Symbol const& symbol) {
+    return value < symbol.address;
+  });
+
+  if (it == file->symbols.begin()) {
+    return nullptr;
+  }
+
+  --it;
+
+  if ((*it).size > 0 && address >= (*it).address + (*it).size) {
+    return nullptr;
+  }
+
+  return (*it).name;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief looks up the line number table row of an address
+////////////////////////////////////////////////////////////////////////////////
+
+static LineRow const* FindLine (SymbolFile const* file, uintptr_t address) {
+  auto it = std::upper_bound(file->lines.begin(), file->lines.end(), address, [] (uintptr_t value, LineRow const& row) {
+    return value < row.address;
+  });
+
+  if (it == file->lines.begin()) {
+    return nullptr;
+  }
+
+  --it;
+
+  if ((*it).file == EndOfSequence) {
+    return nullptr;
+  }
+
+  return &(*it);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief appends a string to a buffer, truncating it if required
+////////////////////////////////////////////////////////////////////////////////
+
+static void Append (char*& buffer, char const* end, char const* value) {
+  size_t length = ::strlen(value);
+
+  if (length > static_cast<size_t>(end - buffer)) {
+    length = end - buffer;
+  }
+
+  ::memcpy(buffer, value, length);
+  buffer += length;
+}
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class Symbolizer
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief symbolizes a code address in the given file, which is loaded at
+/// the given base address
+////////////////////////////////////////////////////////////////////////////////
+
+bool Symbolizer::Symbolize (char const* path, void const* base, void const* pc, char* buffer, size_t length) {
+  SymbolFile* file;
+
+  {
+    std::lock_guard<std::mutex> locker(FilesLock);
+
+    file = Files;
+
+    while (file != nullptr && ::strcmp(file->path, path) != 0) {
+      file = file->next;
+    }
+
+    if (file == nullptr) {
+      file = AddFile(path);
+    }
+  }
+
+  char const* function = nullptr;
+  LineRow const* row = nullptr;
+
+  if (file != nullptr) {
+    // different files are loaded by several threads at the same time
+    std::call_once(file->loaded, LoadFile, file);
+
+    // translate the address into the file's own addresses
+    uintptr_t address = reinterpret_cast<uintptr_t>(pc);
+
+    if (base != nullptr) {
+      address = address - reinterpret_cast<uintptr_t>(base) + file->firstAddress;
+    }
+
+    function = FindFunction(file, address);
+    row = FindLine(file, address);
+  }
+
+  // leave room for the terminating null byte
+  char* p = buffer;
+  char const* end = buffer + length - 1;
+
+  if (function == nullptr) {
+    Append(p, end, "??");
+  }
+  else {
+    int status = -1;
+    char* demangled = nullptr;
+
+    if (function[0] == '_' && function[1] == 'Z') {
+      demangled = abi::__cxa_demangle(function, nullptr, nullptr, &status);
+    }
+
+    if (demangled != nullptr && status == 0) {
+      Append(p, end, demangled);
+    }
+    else {
+      Append(p, end, function);
+    }
+
+    ::free(demangled);
+  }
+
+  Append(p, end, "\n");
+
+  if (row == nullptr) {
+    Append(p, end, function == nullptr ? "??:0" : "??:?");
+  }
+  else {
+    FileName const& name = file->files[row->file];
+
+    if (name.directory != nullptr && name.name[0] != '/') {
+      if (name.base != nullptr) {
+        Append(p, end, name.base);
+        Append(p, end, "/");
+      }
+      Append(p, end, name.directory);
+      Append(p, end, "/");
+    }
+
+    Append(p, end, name.name);
+    Append(p, end, ":");
+
+    if (row->line == 0) {
+      Append(p, end, "?");
+    }
+    else {
+      char number[16];
+      char* q = &number[sizeof(number) - 1];
+      uint32_t line = row->line;
+
+      *q = '\0';
+
+      do {
+        *--q = '0' + (line % 10);
+        line /= 10;
+      }
+      while (line > 0);
+
+      Append(p, end, q);
+    }
+  }
+
+  Append(p, end, "\n");
+  *p = '\0';
+
+  return (file != nullptr && ! file->lines.empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unmaps all files and frees all tables
+////////////////////////////////////////////////////////////////////////////////
+
+void Symbolizer::Release () {
+  std::lock_guard<std::mutex> locker(FilesLock);
+
+  while (Files != nullptr) {
+    SymbolFile* file = Files;
+    Files = file->next;
+
+    if (file->image.data != nullptr) {
+      ::munmap(const_cast<char*>(file->image.data), file->image.size);
+    }
+
+    if (file->debugImage.data != nullptr) {
+      ::munmap(const_cast<char*>(file->debugImage.data), file->debugImage.size);
+    }
+
+    size_t const length = ::strlen(file->path);
+    Arena::Free(file->path, length + 1);
+
+    file->~SymbolFile();
+    Arena::Free(file, sizeof(SymbolFile));
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef LOUSE_SYMBOLIZER_H
+#define LOUSE_SYMBOLIZER_H 1
+
+#include <cstdlib>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class Symbolizer
+// -----------------------------------------------------------------------------
+
+namespace debugging {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief in-process symbolizer for code addresses
+/// each executable or shared library is mapped into memory once. its symbol
+/// table and its DWARF line number program are decoded into sorted address
+/// tables, so that each lookup is a binary search. debug information in a
+/// separate file below /usr/lib/debug/.build-id is used, too. the tables
+/// come from the arena, and the mapped files are unmapped by Release()
+////////////////////////////////////////////////////////////////////////////////
+
+  class Symbolizer {
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+    private:
+
+      Symbolizer () = delete;
+
+      ~Symbolizer () = delete;
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                    public methods
+// -----------------------------------------------------------------------------
+
+    public:
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief symbolizes a code address in the given file, which is loaded at
+/// the given base address. the result is written in the same format as
+/// `addr2line -C -f` produces it: the function name and `file:line`, each
+/// on a line of its own. returns false if the file has no line number 
+/// information that can be read, e.g. because its debug sections are 
+/// compressed. the result then only contains the function name, if any.
+/// may be called by several threads at the same time
+////////////////////////////////////////////////////////////////////////////////
+
+      static bool Symbolize (char const*, void const*, void const*, char*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief unmaps all files and frees all tables
+////////////////////////////////////////////////////////////////////////////////
+
+      static void Release ();
+  };
+}
+
+#endif
@@ -1,21 +1,80 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
+#include <csignal>
 #include <cstring>
+#include <malloc.h>
+#include <unordered_map>
 #include <unordered_set>
 #include <unistd.h>
+#include <vector>
 #include <dlfcn.h>
 #include <fcntl.h>
 
 #include "Tracker.h"
+#include "Arena.h"
+#include "MetadataTable.h"
+#include "StackDepot.h"
 #include "StackResolver.h"
+#include "SymbolCache.h"
+#include "Symbolizer.h"
 #include "Printer.h"
 
+using Arena             = debugging::Arena;
+using BlockMetadata     = debugging::BlockMetadata;
 using Configuration     = debugging::Configuration;
 using MemoryAllocation  = debugging::MemoryAllocation;
 using Printer           = debugging::Printer;
+using StackDepot        = debugging::StackDepot;
 using StackResolver     = debugging::StackResolver;
+using SymbolCache       = debugging::SymbolCache;
+using Symbolizer        = debugging::Symbolizer;
+using LouseScope        = debugging::LouseScope;
 using Tracker           = debugging::Tracker;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief set of hash values, allocated from the arena
+////////////////////////////////////////////////////////////////////////////////
+
+typedef std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                           debugging::ArenaAllocator<uint64_t>> HashSet;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief leaked blocks with the same stack trace and allocation type
+/// leaked blocks without a stack trace are grouped by their size instead
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+  struct LeakGroup {
+    uint32_t                     stack;
+    MemoryAllocation::AccessType type;
+    uint64_t                     blockSize;     // 0 for blocks with a stack
+    uint64_t                     count;
+    uint64_t                     size;
+    uint64_t                     sizeEstimated;
+    double                       countEstimated;
+    uint64_t                     sequence;      // of the first leaked block
+  };
+
+  struct LeakGroupHash {
+    size_t operator() (LeakGroup const& group) const {
+      return std::hash<uint64_t>()((static_cast<uint64_t>(group.stack) << 8 | group.type) ^ 
+                                   (group.blockSize * 0x9e3779b97f4a7c15ULL));
+    }
+  };
+
+  struct LeakGroupEqual {
+    bool operator() (LeakGroup const& lhs, LeakGroup const& rhs) const {
+      return (lhs.stack == rhs.stack && lhs.type == rhs.type && lhs.blockSize == rhs.blockSize);
+    }
+  };
+}
+
+typedef std::unordered_set<LeakGroup, LeakGroupHash, LeakGroupEqual,
+                           debugging::ArenaAllocator<LeakGroup>> LeakGroups;
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                                 private variables
 // -----------------------------------------------------------------------------
@@ -24,6 +83,67 @@ static char* CallocBuffer[1024];
 
 static size_t CallocPosition = 0;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief number of bytes the current thread may still allocate until the
+/// next stack trace is sampled
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread int64_t BytesUntilSample __attribute__ ((tls_model("initial-exec"))) = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief state of the current thread's random number generator for sampling
+/// 0 means the generator has not been seeded yet
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread uint64_t SampleRandom __attribute__ ((tls_model("initial-exec"))) = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the current thread is running louse's own code
+/// that captures or prints stack traces. allocations made by this code are 
+/// still tracked, but get no stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+static __thread bool InLouse __attribute__ ((tls_model("initial-exec"))) = false;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief lowest address of a tracked block ever seen with a size window
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uintptr_t> LowestTracked(UINTPTR_MAX);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief highest address of a tracked block ever seen with a size window
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uintptr_t> HighestTracked(0);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sequence number of the last tracked allocation
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> LastSequence(0);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief maximum number of sequence numbers for --trace-seq
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t const MaxTracedSequences = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sorted sequence numbers of the allocations to trace
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t TracedSequences[MaxTracedSequences];
+
+static size_t NumTracedSequences = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not stack trace capturing is currently paused
+/// flipped by the signal handler for --toggle-signal
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<bool> TracesPaused(false);
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                          private helper functions
 // -----------------------------------------------------------------------------
@@ -45,6 +165,193 @@ static uint64_t HashString (char const* buffer) {
   return hash;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief draws the number of bytes until the next sampled stack trace
+/// the distances between sampled bytes are exponentially distributed, so 
+/// each allocated byte is sampled with the same probability of 1 / mean
+////////////////////////////////////////////////////////////////////////////////
+
+static int64_t NextSampleInterval (uint64_t mean) {
+  if (SampleRandom == 0) {
+    // threads get different seeds from the address of their variable
+    SampleRandom = (reinterpret_cast<uintptr_t>(&SampleRandom) * 0x9e3779b97f4a7c15ULL) | 1;
+  }
+
+  // xorshift64*
+  SampleRandom ^= SampleRandom >> 12;
+  SampleRandom ^= SampleRandom << 25;
+  SampleRandom ^= SampleRandom >> 27;
+  uint64_t const random = SampleRandom * 0x2545f4914f6cdd1dULL;
+
+  // uniformly distributed in (0, 1]
+  double const q = static_cast<double>((random >> 11) + 1) / 9007199254740992.0;
+
+  return static_cast<int64_t>(-std::log(q) * static_cast<double>(mean)) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the stack trace of an allocation is sampled
+////////////////////////////////////////////////////////////////////////////////
+
+static bool MustSample (size_t size, uint64_t mean) {
+  if (SampleRandom == 0) {
+    BytesUntilSample = NextSampleInterval(mean);
+  }
+
+  BytesUntilSample -= static_cast<int64_t>(size);
+
+  if (BytesUntilSample > 0) {
+    return false;
+  }
+
+  BytesUntilSample = NextSampleInterval(mean);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief estimates the number of bytes a sampled allocation stands for
+/// an allocation of the given size is sampled with a probability of 
+/// 1 - exp(-size / mean), so its size is scaled up by the inverse
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t SampledSize (size_t size, uint64_t mean) {
+  if (mean == 0 || size == 0) {
+    return size;
+  }
+
+  double const probability = -std::expm1(-static_cast<double>(size) / static_cast<double>(mean));
+
+  return static_cast<uint64_t>(static_cast<double>(size) / probability);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief estimates the number of allocations a sampled allocation stands for
+////////////////////////////////////////////////////////////////////////////////
+
+static double SampledCount (size_t size, uint64_t mean) {
+  if (mean == 0 || size == 0) {
+    return 1.0;
+  }
+
+  return 1.0 / -std::expm1(-static_cast<double>(size) / static_cast<double>(mean));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief extends the address range of tracked blocks by a new block
+////////////////////////////////////////////////////////////////////////////////
+
+static void NoteTrackedAddress (uintptr_t address) {
+  uintptr_t lowest = LowestTracked.load(std::memory_order_relaxed);
+
+  while (address < lowest &&
+         ! LowestTracked.compare_exchange_weak(lowest, address, std::memory_order_relaxed)) {
+  }
+
+  uintptr_t highest = HighestTracked.load(std::memory_order_relaxed);
+
+  while (address > highest &&
+         ! HighestTracked.compare_exchange_weak(highest, address, std::memory_order_relaxed)) {
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not an address may belong to a tracked block
+/// with a size window, most untracked blocks lie outside the range of the
+/// tracked ones, and are recognized without a table lookup
+////////////////////////////////////////////////////////////////////////////////
+
+static bool MayBeTracked (void const* pointer) {
+  uintptr_t const address = reinterpret_cast<uintptr_t>(pointer);
+
+  return (address >= LowestTracked.load(std::memory_order_relaxed) &&
+          address <= HighestTracked.load(std::memory_order_relaxed));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not the allocator left room for a tail signature after
+/// a block allocated without a header
+////////////////////////////////////////////////////////////////////////////////
+
+static bool HasTailSlack (void* pointer, size_t size) {
+  return (::malloc_usable_size(pointer) >= size + MemoryAllocation::TailSize());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief assigns the next allocation sequence number
+/// in the default header, sequence numbers have 48 bits
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint64_t NextSequence () {
+  return (LastSequence.fetch_add(1, std::memory_order_relaxed) + 1) & 0xffffffffffffULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief parses the comma-separated sequence numbers for --trace-seq
+////////////////////////////////////////////////////////////////////////////////
+
+static void ParseTracedSequences (char const* value) {
+  NumTracedSequences = 0;
+
+  while (*value != '\0' && NumTracedSequences < MaxTracedSequences) {
+    char* end;
+    unsigned long long sequence = ::strtoull(value, &end, 10);
+
+    if (end == value) {
+      // skip invalid characters
+      ++value;
+      continue;
+    }
+
+    if (sequence != 0) {
+      // keep the numbers sorted
+      size_t i = NumTracedSequences++;
+
+      while (i > 0 && TracedSequences[i - 1] > sequence) {
+        TracedSequences[i] = TracedSequences[i - 1];
+        --i;
+      }
+
+      TracedSequences[i] = sequence;
+    }
+
+    value = end;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not an allocation sequence number is to be traced
+////////////////////////////////////////////////////////////////////////////////
+
+static bool IsTracedSequence (uint64_t sequence) {
+  size_t low  = 0;
+  size_t high = NumTracedSequences;
+
+  while (low < high) {
+    size_t const middle = low + (high - low) / 2;
+
+    if (TracedSequences[middle] < sequence) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  return (low < NumTracedSequences && TracedSequences[low] == sequence);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief signal handler for --toggle-signal
+/// pauses or resumes stack trace capturing
+////////////////////////////////////////////////////////////////////////////////
+
+static void ToggleTraces (int) {
+  bool paused = TracesPaused.load(std::memory_order_relaxed);
+
+  while (! TracesPaused.compare_exchange_weak(paused, ! paused, std::memory_order_relaxed)) {
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief startup replacement for malloc()
 ////////////////////////////////////////////////////////////////////////////////
@@ -109,16 +416,25 @@ Tracker::Tracker ()
   : heap_() {
 
   Initialize();
+
+  if (Config.withThreadHeaps && Config.withHeaders) {
+    heap_.usePerThreadLists(ReleaseMemory);
+  }
+
   State = STATE_TRACING;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief destroy the tracker
-/// this performs leak checking
+/// this performs leak checking and afterwards releases louse's own memory.
+/// blocks allocated or freed later are not tracked anymore
 ////////////////////////////////////////////////////////////////////////////////
 
 Tracker::~Tracker () {
   finalize();
+  SymbolCache::Release();
+  Symbolizer::Release();
+  Arena::Release();
 }
 
 // -----------------------------------------------------------------------------
@@ -156,6 +472,12 @@ void Tracker::Initialize () {
       ImmediateAbort("init", "cannot find realloc()");
     }
 
+    auto memalign = GetLibraryFunction<MemalignFuncType>("memalign");
+
+    if (memalign == nullptr) {
+      ImmediateAbort("init", "cannot find memalign()");
+    }
+
     auto free = GetLibraryFunction<FreeFuncType>("free");
 
     if (free == nullptr) {
@@ -174,18 +496,82 @@ void Tracker::Initialize () {
       ImmediateAbort("init", "cannot find _exit()");
     }
 
+    auto pthreadCreate = GetLibraryFunction<PthreadCreateFuncType>("pthread_create");
+
+    if (pthreadCreate == nullptr) {
+      ImmediateAbort("init", "cannot find pthread_create()");
+    }
+
+    auto dlclose = GetLibraryFunction<DlcloseFuncType>("dlclose");
+
+    if (dlclose == nullptr) {
+      ImmediateAbort("init", "cannot find dlclose()");
+    }
+
     LibraryMalloc  = malloc;
     LibraryCalloc  = calloc;
     LibraryRealloc = realloc;
     LibraryFree    = free;
+
+    LibraryMemalign = memalign;
     LibraryExit    = exit;
     Library_Exit   = _exit;
 
+    LibraryPthreadCreate = pthreadCreate;
+    LibraryDlclose       = dlclose;
+
     State = STATE_HOOKED;
 
     // read the configuration from the environment
     Config.fromEnvironment();
 
+    StackResolver::SetUnwinder(Config.unwinder);
+    StackResolver::SetSymbolizer(Config.symbolizer);
+    SymbolCache::SetDirectory(Config.symbolCache);
+
+    if (Config.withTraces && Config.withCallSites) {
+      StackResolver::UseCallSites(Config.callSiteSample);
+    }
+
+    if (Config.withTraces && Config.traceModules != nullptr) {
+      StackResolver::SetTracedModules(Config.traceModules);
+    }
+
+    if (Config.traceSequences != nullptr) {
+#ifdef LOUSE_COMPACT_HEADER
+      if (Config.withHeaders) {
+        // compact headers have no room for sequence numbers, so no
+        // allocation would ever match
+        ImmediateAbort("init", "--trace-seq needs --with-headers=false in builds with compact headers");
+      }
+#endif
+
+      ParseTracedSequences(Config.traceSequences);
+    }
+
+    if (Config.withTraces) {
+      TracesPaused = Config.pauseTraces;
+
+      if (Config.toggleSignal != 0) {
+        struct sigaction action;
+        ::memset(&action, 0, sizeof(action));
+        action.sa_handler = ToggleTraces;
+        action.sa_flags   = SA_RESTART;
+        ::sigemptyset(&action.sa_mask);
+
+        if (::sigaction(Config.toggleSignal, &action, nullptr) != 0) {
+          ImmediateAbort("init", "cannot install handler for --toggle-signal");
+        }
+      }
+    }
+
+    if (Config.withTraces && Config.retrace != nullptr) {
+      if (! StackResolver::LoadFingerprints(Config.retrace)) {
+        // without fingerprints, no stack traces would be captured at all
+        Config.retrace = nullptr;
+      }
+    }
+
     // remove preloader from environment for all sub-processes
     ::unsetenv("LD_PRELOAD");
 
@@ -213,28 +599,52 @@ void Tracker::Exit (int status, bool immediately) {
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief print an error and abort execution
+/// during initialization, OutFile may not be set yet
 ////////////////////////////////////////////////////////////////////////////////
 
 void Tracker::ImmediateAbort (char const* type, char const* message) {
-  Printer::EmitError(OutFile, type, "%s", message);
+  Printer::EmitError((OutFile != nullptr) ? OutFile : stderr, type, "%s", message);
   std::abort();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief allocate some untracked memory
+/// the memory is preceded by the distance to the start of the block and the
+/// size of the memory. this keeps the memory 16-byte aligned
 ////////////////////////////////////////////////////////////////////////////////
 
 void* Tracker::AllocateInitialMemory (size_t size) { 
+  return AllocateInitialAlignedMemory(2 * sizeof(size_t), size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate some untracked aligned memory
+/// the alignment must be a power of two. bigger alignments than 16 bytes
+/// leave a whole alignment unit in front of the memory for its prefix
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::AllocateInitialAlignedMemory (size_t alignment, size_t size) { 
   if (UntrackedPointersLength == sizeof(UntrackedPointers) / sizeof(UntrackedPointers[0])) {
     ImmediateAbort("allocation", "malloc: out of initialization memory\n");
   }
 
-  void* pointer = LibraryMalloc(size + sizeof(size_t));
+  size_t const prefix = std::max(alignment, 2 * sizeof(size_t));
+  void* pointer;
+
+  if (prefix == 2 * sizeof(size_t)) {
+    pointer = LibraryMalloc(prefix + size);
+  }
+  else {
+    if (LibraryMemalign == nullptr) {
+      return nullptr;
+    }
+    pointer = LibraryMemalign(alignment, prefix + size);
+  }
 
   if (pointer != nullptr) {
-    size_t* memory = static_cast<size_t*>(pointer);
-    *memory = size;
-    ++memory;
+    size_t* memory = reinterpret_cast<size_t*>(static_cast<char*>(pointer) + prefix);
+    memory[-2] = prefix;
+    memory[-1] = size;
 
     pointer = static_cast<void*>(memory);
     UntrackedPointers[UntrackedPointersLength++] = pointer;
@@ -250,9 +660,8 @@ void* Tracker::AllocateInitialMemory (size_t size) {
 bool Tracker::FreeInitialMemory (void* pointer) {
   for (size_t i = 0; i < UntrackedPointersLength; ++i) {
     if (UntrackedPointers[i] == pointer) {
-      size_t* memory = static_cast<size_t*>(pointer);
-      --memory;
-      debugging::Tracker::LibraryFree(static_cast<void*>(memory));
+      size_t const prefix = static_cast<size_t*>(pointer)[-2];
+      debugging::Tracker::LibraryFree(static_cast<void*>(static_cast<char*>(pointer) - prefix));
       --UntrackedPointersLength;
 
       for (size_t j = i; j < UntrackedPointersLength; ++j) {
@@ -271,6 +680,15 @@ bool Tracker::FreeInitialMemory (void* pointer) {
 
 void* Tracker::allocateMemory (size_t size, MemoryAllocation::AccessType type) {
   // ::fprintf(stderr, "allocate memory called, size: %lu\n", (unsigned long) size);
+  if (Config.hasSizeWindow() && ! Config.isInSizeWindow(size)) {
+    // not tracked, so no bookkeeping at all
+    return LibraryMalloc(size);
+  }
+
+  if (! Config.withHeaders) {
+    return allocateWithoutHeader(size, type, 0);
+  }
+
   size_t const actualSize = size + MemoryAllocation::TotalSize();
   void* pointer = LibraryMalloc(actualSize);
 
@@ -283,14 +701,54 @@ void* Tracker::allocateMemory (size_t size, MemoryAllocation::AccessType type) {
 
   allocation->init(size, type);
 
-  if (Config.withTraces) { 
-    allocation->stack = StackResolver::captureStackTrace(Config.maxFrames);
+  // ::fprintf(stderr, "allocate returning wrapped pointer %p, orig: %p\n", allocation->memory(), pointer);
+  return trackAllocation(allocation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate aligned memory that is going to be tracked
+/// the block is allocated by the library memalign(), with enough room in
+/// front of the user memory for the header to end right at the aligned
+/// address. the header records the alignment, so the start of the block can
+/// be found again when it is freed
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::allocateAlignedMemory (size_t alignment, size_t size, MemoryAllocation::AccessType type) {
+  if (alignment <= 16) {
+    // malloc() already returns 16-byte aligned memory
+    return allocateMemory(size, type);
   }
 
-  heap_.add(allocation);
+  if (State != STATE_TRACING) {
+    if (LibraryMemalign == nullptr) {
+      return nullptr;
+    }
+    return LibraryMemalign(alignment, size);
+  }
 
-  // ::fprintf(stderr, "allocate returning wrapped pointer %p, orig: %p\n", allocation->memory(), pointer);
-  return allocation->memory();
+  if (Config.hasSizeWindow() && ! Config.isInSizeWindow(size)) {
+    return LibraryMemalign(alignment, size);
+  }
+
+  if (! Config.withHeaders) {
+    return allocateWithoutHeader(size, type, alignment);
+  }
+
+  size_t const headerSpace = MemoryAllocation::HeaderSpace(alignment);
+  void* pointer = LibraryMemalign(alignment, headerSpace + size + MemoryAllocation::TailSize());
+
+  if (pointer == nullptr) {
+    return nullptr;
+  }
+
+  void* memory = static_cast<void*>(static_cast<char*>(pointer) + headerSpace - MemoryAllocation::OwnSize());
+
+  auto allocation = static_cast<MemoryAllocation*>(memory);
+
+  allocation->init(size, type);
+  allocation->alignShift = __builtin_ctzll(alignment);
+
+  return trackAllocation(allocation);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -298,7 +756,7 @@ void* Tracker::allocateMemory (size_t size, MemoryAllocation::AccessType type) {
 /// this will already report errors
 ////////////////////////////////////////////////////////////////////////////////
 
-void Tracker::freeMemory (void* pointer, MemoryAllocation::AccessType type) {
+void Tracker::freeMemory (void* pointer, MemoryAllocation::AccessType type, size_t size) {
   // ::fprintf(stderr, "freeMemory called with %p\n", pointer);
   if (pointer == nullptr) {
     return; 
@@ -316,92 +774,171 @@ void Tracker::freeMemory (void* pointer, MemoryAllocation::AccessType type) {
     return;
   }
 
-  void* mem = static_cast<void*>(static_cast<char*>(pointer) - MemoryAllocation::OwnSize());
+  if (! Config.withHeaders) {
+    freeWithoutHeader(pointer, type, size);
+    return;
+  }
 
-  auto allocation = static_cast<MemoryAllocation*>(mem);
+  void* memory = static_cast<void*>(static_cast<char*>(pointer) - MemoryAllocation::OwnSize());
 
-  if (! allocation->isOwnSignatureValid()) {
-    Printer::EmitError(OutFile,
-                       "runtime",
-                       "%s called with invalid memory pointer %p", 
-                       MemoryAllocation::AccessTypeName(type),
-                       pointer);
+  auto allocation = static_cast<MemoryAllocation*>(memory);
 
-    emitStackTrace();
-  }
-  else {
-    if (type != MemoryAllocation::MatchingFreeType(allocation->type)) {
-      Printer::EmitError(OutFile,
-                         "runtime",
-                         "trying to %s memory pointer %p that was originally allocated via %s",
-                         MemoryAllocation::AccessTypeName(type),
-                         pointer,
-                         MemoryAllocation::AccessTypeName(allocation->type));
-
-      emitStackTrace();
-
-      if (allocation->stack != nullptr) {
-        Printer::EmitLine(OutFile, "");
-        Printer::EmitLine(OutFile,
-                          "original allocation site of memory pointer %p via %s:",
-                          pointer,
-                          MemoryAllocation::AccessTypeName(allocation->type));
-
-        emitStackTrace(allocation->stack);
-      }
-    }
+  if (! allocation->isOwnSignatureValid()) {
+    reportInvalidPointer(pointer, type);
 
-    if (! allocation->isTailSignatureValid()) {
-      Printer::EmitError(OutFile,
-                         "runtime",
-                         "buffer overrun after memory pointer %p of size %llu that was originally allocated via %s",
-                         pointer,
-                         static_cast<unsigned long long>(allocation->size),
-                         MemoryAllocation::AccessTypeName(allocation->type));
-
-      emitStackTrace();
-
-      if (allocation->stack != nullptr) {
-        Printer::EmitLine(OutFile, "");
-        Printer::EmitLine(OutFile,
-                          "original allocation site of memory pointer %p via %s:",
-                          pointer,
-                          MemoryAllocation::AccessTypeName(allocation->type));
-
-        emitStackTrace(allocation->stack);
-      }
-    }
+    // the block is not ours, or was freed already. touching it any further
+    // would likely crash
+    return;
   }
 
-  heap_.remove(allocation);
+  checkDeallocation(pointer, type, size, allocation->size, allocation->type, allocation->stack, allocation->sequence());
 
+  // wipe the signature first, so a concurrent double free can be detected
+  // even while the block is still queued for removal by its owning thread
   allocation->wipeSignature();
 
-  if (allocation->stack != nullptr) {
-    LibraryFree(allocation->stack);
+  if (Arena::IsReleased()) {
+    // tracking has ended and the heap's bookkeeping is gone
+    ReleaseMemory(allocation);
+    return;
   }
 
-  LibraryFree(mem);
+  if (heap_.remove(allocation)) {
+    ReleaseMemory(allocation);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief get the size of a memory allocation
+/// @brief resize tracked memory
+/// the block is resized by the library realloc(), so it can grow in place.
+/// the block's header and tail signature are updated for the new size, and
+/// the block keeps its sequence number and stacktrace. a resized block does
+/// not count as a new allocation, only its change in size is counted
 ////////////////////////////////////////////////////////////////////////////////
- 
-size_t Tracker::memorySize (void* pointer) const {
+
+void* Tracker::reallocateMemory (void* pointer, size_t size) {
+  if (State != STATE_TRACING) {
+    return reallocateByCopy(pointer, size);
+  }
+
   for (size_t i = 0; i < UntrackedPointersLength; ++i) {
     if (UntrackedPointers[i] == pointer) {
-      size_t* memory = static_cast<size_t*>(pointer);
-      --memory;
-      return *memory;
+      return reallocateByCopy(pointer, size);
     }
   }
 
+  if (! Config.withHeaders) {
+    return reallocateWithoutHeader(pointer, size);
+  }
+
   void* memory = static_cast<void*>(static_cast<char*>(pointer) - MemoryAllocation::OwnSize());
+
   auto allocation = static_cast<MemoryAllocation*>(memory);
 
-  if (allocation->isOwnSignatureValid()) {
-    return allocation->size;
+  if (! allocation->isOwnSignatureValid()) {
+    // this will report the invalid pointer
+    return reallocateByCopy(pointer, size);
+  }
+
+  if (allocation->alignShift != 0) {
+    // the header of an aligned block is not at the start of the block
+    return reallocateByCopy(pointer, size);
+  }
+
+  if (Arena::IsReleased()) {
+    // tracking has ended. just keep the header intact
+    memory = LibraryRealloc(memory, size + MemoryAllocation::TotalSize());
+
+    if (memory == nullptr) {
+      return nullptr;
+    }
+
+    allocation = static_cast<MemoryAllocation*>(memory);
+    allocation->init(size, MemoryAllocation::TYPE_MALLOC);
+
+    return allocation->memory();
+  }
+
+  if (! heap_.detach(allocation)) {
+    // block is owned by another thread
+    return reallocateByCopy(pointer, size);
+  }
+
+  checkDeallocation(pointer, MemoryAllocation::TYPE_FREE, 0, allocation->size, allocation->type, allocation->stack, allocation->sequence());
+
+  // the header may move, so save what is kept
+  size_t const counted    = allocation->size;
+  uint32_t const stack    = allocation->stack;
+  uint64_t const sequence = allocation->sequence();
+
+  memory = LibraryRealloc(memory, size + MemoryAllocation::TotalSize());
+
+  if (memory == nullptr) {
+    // the original block is still valid
+    heap_.restore(allocation, counted);
+    return nullptr;
+  }
+
+  allocation = static_cast<MemoryAllocation*>(memory);
+  allocation->init(size, MemoryAllocation::TYPE_MALLOC);
+
+  allocation->setSequence(sequence);
+  allocation->stack = stack;
+
+  heap_.restore(allocation, counted);
+
+  return allocation->memory();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief release the memory of a tracked block that was removed from the
+/// heap already
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::ReleaseMemory (MemoryAllocation* allocation) {
+  LibraryFree(allocation->base());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the size of a memory allocation
+////////////////////////////////////////////////////////////////////////////////
+ 
+size_t Tracker::memorySize (void* pointer) const {
+  for (size_t i = 0; i < UntrackedPointersLength; ++i) {
+    if (UntrackedPointers[i] == pointer) {
+      size_t* memory = static_cast<size_t*>(pointer);
+      --memory;
+      return *memory;
+    }
+  }
+
+  if (! Config.withHeaders) {
+    if (Arena::IsReleased()) {
+      // the metadata is gone. the usable size is at least the block's size,
+      // so copying this much is safe
+      return ::malloc_usable_size(pointer);
+    }
+
+    BlockMetadata entry;
+
+    if (table_.lookup(pointer, entry)) {
+      return entry.size;
+    }
+
+    if (Config.hasSizeWindow()) {
+      // a block outside the size window
+      return ::malloc_usable_size(pointer);
+    }
+
+    // unknown pointer!
+    return 0;
+  }
+
+  void* memory = static_cast<void*>(static_cast<char*>(pointer) - MemoryAllocation::OwnSize());
+  auto allocation = static_cast<MemoryAllocation*>(memory);
+
+  if (allocation->isOwnSignatureValid()) {
+    return allocation->size;
   }
 
   // unknown pointer!
@@ -462,11 +999,370 @@ bool Tracker::mustSuppressLeak (char const* stack, regex_t* regex) {
   return true;
 }
     
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate memory that is going to be tracked, without a header
+/// the block's metadata is kept in the metadata table, so the pointer
+/// returned is the one returned by the library malloc() or memalign(), and
+/// the block is not enlarged. the tail signature is only written if the
+/// allocator's rounding left room for it after the block. an alignment of 0
+/// means the block is allocated via malloc()
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::allocateWithoutHeader (size_t size, MemoryAllocation::AccessType type, size_t alignment) {
+  void* pointer = (alignment == 0) ? LibraryMalloc(size) : LibraryMemalign(alignment, size);
+
+  if (pointer == nullptr || State != STATE_TRACING || Arena::IsReleased()) {
+    return pointer;
+  }
+
+  if (HasTailSlack(pointer, size)) {
+    MemoryAllocation::SetTailSignature(pointer, size);
+  }
+
+  BlockMetadata entry;
+  entry.address = reinterpret_cast<uintptr_t>(pointer);
+  entry.size    = size;
+  entry.type    = type;
+  entry.setSequence(NextSequence());
+  entry.stack   = captureAllocationStack(size, entry.sequence());
+
+  if (! table_.insert(entry)) {
+    ImmediateAbort("allocation", "cannot grow metadata table");
+  }
+
+  if (Config.hasSizeWindow()) {
+    NoteTrackedAddress(entry.address);
+  }
+
+  return pointer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a freshly allocated memory block with a header to the heap
+/// returns the block's user memory
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::trackAllocation (MemoryAllocation* allocation) {
+  if (Arena::IsReleased()) {
+    // tracking has ended. the block keeps its header so it can be freed
+    return allocation->memory();
+  }
+
+  allocation->setSequence(NextSequence());
+  allocation->stack = captureAllocationStack(allocation->size, allocation->sequence());
+
+  heap_.add(allocation);
+
+  return allocation->memory();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief capture the stacktrace for a new memory block of the given size
+/// and sequence number. with --record-leaks, only the caller is captured.
+/// with --trace-seq, only the allocations with these sequence numbers get a
+/// stack trace. while capturing is paused via --toggle-signal, no stack 
+/// traces are captured. with --retrace, only allocations matching a recorded
+/// leak get a stack trace. with --trace-modules, only allocations called from
+/// these modules get a stack trace. with --sample-bytes, only about one in 
+/// that many allocated bytes gets a stack trace. all blocks are tracked and 
+/// checked regardless
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t Tracker::captureAllocationStack (size_t size, uint64_t sequence) {
+  if (InLouse) {
+    // allocated while capturing or printing stack traces, e.g. when a
+    // library used for unwinding allocates. unwinding again could recurse
+    return 0;
+  }
+
+  LouseScope scope;
+
+  if (Config.recordLeaks != nullptr) {
+    // the caller is enough for a leak's fingerprint
+    return StackResolver::captureCaller();
+  }
+
+  if (NumTracedSequences > 0) {
+    if (! IsTracedSequence(sequence)) {
+      return 0;
+    }
+
+    if (Config.trapSequences) {
+      // stops in the debugger, right in the allocation
+      ::raise(SIGTRAP);
+    }
+  }
+
+  if (! Config.withTraces) {
+    return 0;
+  }
+
+  if (TracesPaused.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+
+  if (Config.retrace != nullptr && ! StackResolver::IsFingerprinted(size)) {
+    return 0;
+  }
+
+  if (Config.traceModules != nullptr && ! StackResolver::IsTracedCaller()) {
+    return 0;
+  }
+
+  if (Config.sampleBytes > 0 && ! MustSample(size, Config.sampleBytes)) {
+    return 0;
+  }
+
+  return StackResolver::captureStackTrace(Config.maxFrames);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief free tracked memory that was allocated without a header
+/// unknown pointers are detected by a table lookup, so they are never 
+/// dereferenced
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::freeWithoutHeader (void* pointer, MemoryAllocation::AccessType type, size_t size) {
+  if (Arena::IsReleased()) {
+    // tracking has ended and the table is gone
+    LibraryFree(pointer);
+    return;
+  }
+
+  if (Config.hasSizeWindow() && ! MayBeTracked(pointer)) {
+    // a block outside the size window
+    LibraryFree(pointer);
+    return;
+  }
+
+  BlockMetadata entry;
+
+  if (! table_.remove(pointer, entry)) {
+    if (Config.hasSizeWindow()) {
+      // most likely a block outside the size window. invalid pointers
+      // cannot be told apart from these
+      LibraryFree(pointer);
+      return;
+    }
+
+    reportInvalidPointer(pointer, type);
+    return;
+  }
+
+  checkDeallocation(pointer, type, size, entry.size, entry.type, entry.stack, entry.sequence());
+
+  LibraryFree(pointer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize tracked memory that was allocated without a header
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::reallocateWithoutHeader (void* pointer, size_t size) {
+  if (Arena::IsReleased()) {
+    // tracking has ended and the table is gone
+    return LibraryRealloc(pointer, size);
+  }
+
+  BlockMetadata entry;
+
+  if ((Config.hasSizeWindow() && ! MayBeTracked(pointer)) ||
+      ! table_.remove(pointer, entry)) {
+    if (Config.hasSizeWindow()) {
+      // a block outside the size window
+      return reallocateUntracked(pointer, size);
+    }
+
+    // this will report the invalid pointer
+    return reallocateByCopy(pointer, size);
+  }
+
+  checkDeallocation(pointer, MemoryAllocation::TYPE_FREE, 0, entry.size, entry.type, entry.stack, entry.sequence());
+
+  if (! Config.isInSizeWindow(size)) {
+    // the block leaves the size window, and is not tracked anymore
+    return LibraryRealloc(pointer, size);
+  }
+
+  size_t const counted = entry.size;
+
+  void* memory = LibraryRealloc(pointer, size);
+
+  if (memory == nullptr) {
+    // the original block is still valid
+    table_.restore(entry, counted);
+    return nullptr;
+  }
+
+  if (HasTailSlack(memory, size)) {
+    MemoryAllocation::SetTailSignature(memory, size);
+  }
+
+  // the entry keeps its sequence number and stacktrace
+  entry.address = reinterpret_cast<uintptr_t>(memory);
+  entry.size    = size;
+  entry.type    = MemoryAllocation::TYPE_MALLOC;
+
+  if (! table_.restore(entry, counted)) {
+    ImmediateAbort("allocation", "cannot grow metadata table");
+  }
+
+  if (Config.hasSizeWindow()) {
+    NoteTrackedAddress(entry.address);
+  }
+
+  return memory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize a block outside the size window
+/// the block is resized in place if it stays outside the window, and is
+/// moved into a tracked block otherwise
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::reallocateUntracked (void* pointer, size_t size) {
+  if (! Config.isInSizeWindow(size)) {
+    return LibraryRealloc(pointer, size);
+  }
+
+  size_t const oldSize = ::malloc_usable_size(pointer);
+
+  void* memory = allocateMemory(size, MemoryAllocation::TYPE_MALLOC);
+
+  if (memory != nullptr) {
+    ::memcpy(memory, pointer, (oldSize < size) ? oldSize : size);
+    LibraryFree(pointer);
+  }
+
+  return memory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize memory by allocating a new block and copying the contents
+/// this is used for blocks that cannot be resized in place, e.g. untracked
+/// blocks or blocks owned by another thread
+////////////////////////////////////////////////////////////////////////////////
+
+void* Tracker::reallocateByCopy (void* pointer, size_t size) {
+  size_t oldSize = memorySize(pointer);
+
+  void* memory = allocateMemory(size, MemoryAllocation::TYPE_MALLOC);
+
+  if (memory != nullptr) {
+    ::memcpy(memory, pointer, (oldSize < size) ? oldSize : size);
+    freeMemory(pointer, MemoryAllocation::TYPE_FREE);
+  }
+
+  return memory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief report a deallocation of an unknown memory pointer
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::reportInvalidPointer (void* pointer, MemoryAllocation::AccessType type) {
+  Printer::EmitError(OutFile,
+                     "runtime",
+                     "%s called with invalid memory pointer %p", 
+                     MemoryAllocation::AccessTypeName(type),
+                     pointer);
+
+  emitStackTrace();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief check a deallocation for a mismatching method, a wrong size passed
+/// to sized deallocation and buffer overruns
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::checkDeallocation (void* pointer, 
+                                 MemoryAllocation::AccessType type,
+                                 size_t passedSize,
+                                 size_t size,
+                                 MemoryAllocation::AccessType allocationType,
+                                 uint32_t stack,
+                                 uint64_t sequence) {
+  // memory may be freed with or without passing its size
+  if (MemoryAllocation::UnsizedFreeType(type) != MemoryAllocation::MatchingFreeType(allocationType)) {
+    Printer::EmitError(OutFile,
+                       "runtime",
+                       "trying to %s memory pointer %p that was originally allocated via %s",
+                       MemoryAllocation::AccessTypeName(type),
+                       pointer,
+                       MemoryAllocation::AccessTypeName(allocationType));
+
+    emitStackTrace();
+    emitAllocationSite(pointer, allocationType, stack, sequence);
+  }
+  else if (MemoryAllocation::IsSizedFreeType(type) && passedSize != size) {
+    // allocators such as tcmalloc and jemalloc look up the block's size 
+    // class from the size passed, so this corrupts their heaps
+    Printer::EmitError(OutFile,
+                       "runtime",
+                       "%s called with wrong size %llu for memory pointer %p of size %llu",
+                       MemoryAllocation::AccessTypeName(type),
+                       static_cast<unsigned long long>(passedSize),
+                       pointer,
+                       static_cast<unsigned long long>(size));
+
+    emitStackTrace();
+    emitAllocationSite(pointer, allocationType, stack, sequence);
+  }
+
+  // without headers, a block only has a tail signature if the allocator
+  // left room for it
+  bool const hasTail = (Config.withHeaders || HasTailSlack(pointer, size));
+
+  if (hasTail && ! MemoryAllocation::IsTailSignatureValid(pointer, size)) {
+    Printer::EmitError(OutFile,
+                       "runtime",
+                       "buffer overrun after memory pointer %p of size %llu that was originally allocated via %s",
+                       pointer,
+                       static_cast<unsigned long long>(size),
+                       MemoryAllocation::AccessTypeName(allocationType));
+
+    emitStackTrace();
+    emitAllocationSite(pointer, allocationType, stack, sequence);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief prints the allocation site of a memory block
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::emitAllocationSite (void* pointer, 
+                                  MemoryAllocation::AccessType allocationType,
+                                  uint32_t stack,
+                                  uint64_t sequence) {
+  if (stack == 0 && sequence == 0) {
+    return;
+  }
+
+  Printer::EmitLine(OutFile, "");
+
+  if (sequence != 0) {
+    Printer::EmitLine(OutFile,
+                      "original allocation site of memory pointer %p via %s (allocation #%llu):",
+                      pointer,
+                      MemoryAllocation::AccessTypeName(allocationType),
+                      static_cast<unsigned long long>(sequence));
+  }
+  else {
+    Printer::EmitLine(OutFile,
+                      "original allocation site of memory pointer %p via %s:",
+                      pointer,
+                      MemoryAllocation::AccessTypeName(allocationType));
+  }
+
+  emitStackTrace(StackDepot::Get(stack));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief prints the current stacktrace
 ////////////////////////////////////////////////////////////////////////////////
 
 void Tracker::emitStackTrace () {
+  LouseScope scope;
   void* stack[64];
 
   if (! StackResolver::captureStackTrace(Config.maxFrames, &stack[0], sizeof(stack) / sizeof(stack[0]))) {
@@ -485,6 +1381,7 @@ void Tracker::emitStackTrace (void** stack) {
     return;
   }
 
+  LouseScope scope;
   StackResolver resolver;
 
   char memory[4096];
@@ -501,11 +1398,12 @@ void Tracker::emitStackTrace (void** stack) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief print overall results for the linked list of memory blocks,
-/// starting with the argument
+/// @brief print overall results for all memory blocks on the heap
 ////////////////////////////////////////////////////////////////////////////////
 
 void Tracker::emitResults (regex_t* regex) {
+  LouseScope scope;
+
   // rebind to tty if printing to OutFile is not possible 
   if (::fprintf(OutFile, "%s", "") < 0) {
     OutFile = ::fopen("/dev/tty", "w");
@@ -515,8 +1413,16 @@ void Tracker::emitResults (regex_t* regex) {
   Printer::EmitLine(OutFile, "RESULTS --------------------------------------------------------");
   Printer::EmitLine(OutFile, "");
 
-  auto begin = heap_.begin(); // save current head of heap!
-  auto stats = heap_.totals();
+  std::pair<uint64_t, uint64_t> stats;
+
+  if (Config.withHeaders) {
+    heap_.snapshot(); // save current heads of heap!
+    stats = heap_.totals();
+  }
+  else {
+    table_.snapshot();
+    stats = table_.totals();
+  }
 
   Printer::EmitLine(OutFile,
                     "# total number of allocations: %llu",
@@ -526,7 +1432,27 @@ void Tracker::emitResults (regex_t* regex) {
                     "# total size of allocations: %llu",
                     static_cast<unsigned long long>(stats.second));
 
-  if (heap_.isCorrupted(begin)) {
+  if (Config.withTraces) {
+    Printer::EmitLine(OutFile,
+                      "# number of unique stack traces: %llu",
+                      static_cast<unsigned long long>(StackDepot::Size()));
+
+    if (Config.sampleBytes > 0) {
+      Printer::EmitLine(OutFile,
+                        "# stack traces sampled once per %llu allocated byte(s) on average",
+                        static_cast<unsigned long long>(Config.sampleBytes));
+    }
+  }
+
+  auto arena = Arena::GetStatistics();
+
+  Printer::EmitLine(OutFile,
+                    "# louse metadata: %llu allocation(s), %llu byte(s) in use, %llu byte(s) mapped",
+                    static_cast<unsigned long long>(arena.numAllocations),
+                    static_cast<unsigned long long>(arena.bytesUsed),
+                    static_cast<unsigned long long>(arena.bytesMapped));
+
+  if (Config.withHeaders && heap_.isCorrupted()) {
     Printer::EmitError(OutFile,
                        "check", 
                        "heap is corrupted - leak checking is not possible");
@@ -534,88 +1460,353 @@ void Tracker::emitResults (regex_t* regex) {
   }
 
   if (Config.withLeaks) {
-    emitLeaks(begin, regex);
+    emitLeaks(regex);
+  }
+
+  if (Config.recordLeaks != nullptr) {
+    recordLeakFingerprints();
   }
 
   Printer::EmitLine(OutFile, "");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief print all leaks for the memory blocks, starting with the argument
+/// @brief print all leaks for the memory blocks saved in the heap snapshot
+/// leaked blocks are grouped by their stack traces, and the groups are 
+/// printed in the order of their total size. all stack traces are resolved,
+/// so that suppressed groups are left out of the totals, and groups with the
+/// same resolved text are reported as one. only --max-leaks groups are
+/// printed
 ////////////////////////////////////////////////////////////////////////////////
 
-void Tracker::emitLeaks (MemoryAllocation const* heap, regex_t* regex) { 
+void Tracker::emitLeaks (regex_t* regex) { 
   char memory[16384];
 
   int shown              = 0;
   uint64_t numLeaks      = 0;
   uint64_t numDuplicates = 0;
   uint64_t sizeLeaks     = 0;
-  auto allocation = heap;
+  uint64_t numUntraced  = 0;
+  uint64_t sizeUntraced = 0;
+  uint64_t sizeEstimated = 0;
+
+  // with sampling, traced modules, retracing, traced sequence numbers or
+  // paused capturing, not all blocks have a stack trace
+  bool const selective = (Config.recordLeaks == nullptr &&
+                          Config.withTraces && 
+                          (Config.sampleBytes > 0 || 
+                           Config.traceModules != nullptr ||
+                           Config.retrace != nullptr ||
+                           NumTracedSequences > 0 ||
+                           Config.toggleSignal != 0 ||
+                           Config.pauseTraces));
+
+  // group the leaked blocks by their raw stack traces first, so each stack
+  // trace is resolved only once
+  LeakGroups groups;
+
+  auto add = [&] (size_t size, MemoryAllocation::AccessType type, uint32_t id, uint64_t sequence) -> bool {
+    if (selective && id == 0) {
+      // leaked, but the stack trace was not captured
+      ++numUntraced;
+      sizeUntraced += size;
+      return true;
+    }
+
+    LeakGroup key;
+    key.stack          = id;
+    key.type           = type;
+    key.blockSize      = (id == 0) ? size : 0;
+    key.count          = 0;
+    key.size           = 0;
+    key.sizeEstimated  = 0;
+    key.countEstimated = 0.0;
+    key.sequence       = 0;
+
+    // only the counters are modified, which are not part of the key
+    auto& group = const_cast<LeakGroup&>(*groups.emplace(key).first);
+    ++group.count;
+    group.size += size;
+    group.sizeEstimated += SampledSize(size, Config.sampleBytes);
+    group.countEstimated += SampledCount(size, Config.sampleBytes);
+
+    if (sequence != 0 && (group.sequence == 0 || sequence < group.sequence)) {
+      group.sequence = sequence;
+    }
+
+    return true;
+  };
+
+  if (Config.withHeaders) {
+    heap_.visit([&] (MemoryAllocation const* allocation) -> bool {
+      if (! allocation->isOwnSignatureValid()) {
+        // freed, but still queued for removal
+        return true;
+      }
+
+      return add(allocation->size, allocation->type, allocation->stack, allocation->sequence());
+    });
+  }
+  else {
+    table_.visit([&] (BlockMetadata const& entry) -> bool {
+      return add(entry.size, entry.type, entry.stack, entry.sequence());
+    });
+  }
+
+  // the groups with the most leaked bytes come first
+  auto ranking = [] (LeakGroup const& lhs, LeakGroup const& rhs) {
+    if (lhs.size != rhs.size) {
+      return lhs.size > rhs.size;
+    }
+    if (lhs.count != rhs.count) {
+      return lhs.count > rhs.count;
+    }
+    if (lhs.sequence != rhs.sequence) {
+      return lhs.sequence < rhs.sequence;
+    }
+    if (lhs.stack != rhs.stack) {
+      return lhs.stack < rhs.stack;
+    }
+    return lhs.blockSize < rhs.blockSize;
+  };
+
+  std::vector<LeakGroup, debugging::ArenaAllocator<LeakGroup>> ranked(groups.begin(), groups.end());
+  groups.clear();
+
+  std::sort(ranked.begin(), ranked.end(), ranking);
 
-  std::unordered_set<uint64_t> seen;
   StackResolver resolver;
 
-  while (allocation != nullptr) {
+  if (Config.symbolizeThreads > 1) {
+    // resolve the addresses of all stack traces on several threads first.
+    // resolveStack() then finds them in the resolver's cache
+    try {
+      std::vector<void**, debugging::ArenaAllocator<void**>> stacks;
+      stacks.reserve(ranked.size());
+
+      for (auto const& group : ranked) {
+        stacks.emplace_back(StackDepot::Get(group.stack));
+      }
+
+      resolver.resolveStacks(Config.maxFrames,
+                             Printer::UseColors(OutFile),
+                             stacks.data(),
+                             stacks.size(),
+                             Config.symbolizeThreads);
+    }
+    catch (...) {
+      // resolveStack() resolves the stack traces on its own
+    }
+  }
+
+  // drop the suppressed groups, and merge groups whose different stack 
+  // traces resolve to the same text into the largest of them. the totals 
+  // include all remaining groups, not only the ones printed
+  std::unordered_map<uint64_t, size_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                     debugging::ArenaAllocator<std::pair<uint64_t const, size_t>>> seen;
+  size_t kept = 0;
+
+  for (size_t i = 0; i < ranked.size(); ++i) {
+    LeakGroup const group = ranked[i];
+
     char* stack = resolver.resolveStack(Config.maxFrames, 
                                         Printer::UseColors(OutFile), 
                                         &memory[0], 
                                         sizeof(memory), 
-                                        allocation->stack);
+                                        StackDepot::Get(group.stack));
 
-    if (! mustSuppressLeak(stack, regex)) {
+    if (mustSuppressLeak(stack, regex)) {
+      continue;
+    }
 
-      if (stack != nullptr) {
-        uint64_t hash = HashString(stack);
+    sizeLeaks += group.size;
+    sizeEstimated += group.sizeEstimated;
 
-        if (seen.find(hash) != seen.end()) {
-          // duplicate
-          ++numDuplicates;
-          sizeLeaks += allocation->size;
+    if (stack != nullptr) {
+      auto it = seen.emplace(HashString(stack), kept);
 
-          allocation = allocation->next;
-          continue;
-        }
+      if (! it.second) {
+        LeakGroup& first = ranked[(*it.first).second];
+        first.count += group.count;
+        first.size += group.size;
+        first.sizeEstimated += group.sizeEstimated;
+        first.countEstimated += group.countEstimated;
 
-        seen.emplace(hash);
+        if (group.sequence != 0 && (first.sequence == 0 || group.sequence < first.sequence)) {
+          first.sequence = group.sequence;
+        }
+        continue;
       }
+    }
+
+    ranked[kept++] = group;
+  }
+
+  ranked.erase(ranked.begin() + kept, ranked.end());
 
+  // merged groups may have moved up
+  std::sort(ranked.begin(), ranked.end(), ranking);
+
+  for (auto const& group : ranked) {
+    numDuplicates += group.count - 1;
+  }
+
+  numLeaks = ranked.size();
+
+  for (size_t i = 0; i < ranked.size(); ++i) {
+    LeakGroup const& group = ranked[i];
+
+    if (shown >= Config.maxLeaks) {
+      Printer::EmitError(OutFile,   
+                         "check",
+                         "stopping output at %d unique leak(s), results are incomplete",
+                         shown); 
+      break;
+    }
+
+    char* stack = resolver.resolveStack(Config.maxFrames, 
+                                        Printer::UseColors(OutFile), 
+                                        &memory[0], 
+                                        sizeof(memory), 
+                                        StackDepot::Get(group.stack));
+
+    char sequence[48] = "";
+
+    if (group.sequence != 0) {
+      ::snprintf(&sequence[0], sizeof(sequence), " (%sallocation #%llu)", 
+                 (group.count > 1 ? "first " : ""),
+                 static_cast<unsigned long long>(group.sequence));
+    }
+
+    if (Config.withTraces && Config.sampleBytes > 0) {
+      // only the sampled blocks of this stack trace are known. scaling them
+      // up estimates all blocks leaked here
       Printer::EmitError(OutFile,
                          "check", 
-                         "leak of size %llu byte(s), allocated via %s:",
-                         static_cast<unsigned long long>(allocation->size),
-                         MemoryAllocation::AccessTypeName(allocation->type));
-
-      Printer::EmitLine(OutFile,
-                        "%s", 
-                        (stack ? stack : "  # no stack available"));
-    
-      ++numLeaks;
-      sizeLeaks += allocation->size;
-
-      if (++shown >= Config.maxLeaks) {
-        Printer::EmitError(OutFile,   
-                           "check",
-                           "stopping output at %d unique leak(s), results are incomplete",
-                           shown); 
-        break;
-      }
+                         "leak of an estimated %llu block(s) with total size of %llu byte(s) (%llu block(s) with %llu byte(s) sampled), allocated via %s%s:",
+                         static_cast<unsigned long long>(std::llround(group.countEstimated)),
+                         static_cast<unsigned long long>(group.sizeEstimated),
+                         static_cast<unsigned long long>(group.count),
+                         static_cast<unsigned long long>(group.size),
+                         MemoryAllocation::AccessTypeName(group.type),
+                         sequence);
+    }
+    else if (group.count > 1) {
+      Printer::EmitError(OutFile,
+                         "check", 
+                         "leak of %llu block(s) with total size of %llu byte(s), allocated via %s%s:",
+                         static_cast<unsigned long long>(group.count),
+                         static_cast<unsigned long long>(group.size),
+                         MemoryAllocation::AccessTypeName(group.type),
+                         sequence);
+    }
+    else {
+      Printer::EmitError(OutFile,
+                         "check", 
+                         "leak of size %llu byte(s), allocated via %s%s:",
+                         static_cast<unsigned long long>(group.size),
+                         MemoryAllocation::AccessTypeName(group.type),
+                         sequence);
     }
 
-    allocation = allocation->next;
-  } 
+    Printer::EmitLine(OutFile,
+                      "%s", 
+                      (stack ? stack : "  # no stack available"));
+  
+    ++shown;
+  }
 
-  if (sizeLeaks == 0) {
+  if (sizeLeaks == 0 && sizeUntraced == 0) {
     Printer::EmitLine(OutFile, "# no leaks found");
+    return;
   }
-  else {
+
+  Printer::EmitError(OutFile,
+                     "check", 
+                     "found %llu unique leaks(s), %llu duplicates, with total size of %llu byte(s)",
+                     static_cast<unsigned long long>(numLeaks),
+                     static_cast<unsigned long long>(numDuplicates),
+                     static_cast<unsigned long long>(sizeLeaks));
+
+  if (Config.withTraces && Config.sampleBytes > 0) {
+    // every leaked block is known, but only the sampled ones have a stack
+    // trace. scaling them up estimates the leaked bytes per stack trace
+    Printer::EmitError(OutFile,
+                       "check", 
+                       "sampled leaks stand for an estimated %llu byte(s)",
+                       static_cast<unsigned long long>(sizeEstimated));
+  }
+
+  if (selective && numUntraced > 0) {
     Printer::EmitError(OutFile,
                        "check", 
-                       "found %llu unique leaks(s), %llu duplicates, with total size of %llu byte(s)",
-                       static_cast<unsigned long long>(numLeaks),
-                       static_cast<unsigned long long>(numDuplicates),
-                       static_cast<unsigned long long>(sizeLeaks));
+                       "%llu more leak(s) with total size of %llu byte(s) have no stack trace",
+                       static_cast<unsigned long long>(numUntraced),
+                       static_cast<unsigned long long>(sizeUntraced));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief write the fingerprints of all leaks in the heap snapshot to the
+/// file given by --record-leaks, so a later run can retrace them
+////////////////////////////////////////////////////////////////////////////////
+
+void Tracker::recordLeakFingerprints () {
+  FILE* file = ::fopen(Config.recordLeaks, "w");
+
+  if (file == nullptr) {
+    Printer::EmitError(OutFile,
+                       "check",
+                       "cannot write leak fingerprints to '%s'",
+                       Config.recordLeaks);
+    return;
+  }
+
+  ::fprintf(file, "# louse leak fingerprints: module offset size\n");
+
+  uint64_t numFingerprints = 0;
+  HashSet seen;
+
+  auto record = [&] (size_t size, uint32_t id) -> bool {
+    void** stack = StackDepot::Get(id);
+
+    if (stack == nullptr || *stack == nullptr) {
+      return true;
+    }
+
+    char buffer[512];
+    size_t length = StackResolver::FormatFingerprint(stack[0], size, &buffer[0], sizeof(buffer));
+
+    if (length > 0 && seen.emplace(HashString(&buffer[0])).second) {
+      ::fwrite(&buffer[0], 1, length, file);
+      ++numFingerprints;
+    }
+
+    return true;
+  };
+
+  if (Config.withHeaders) {
+    heap_.visit([&] (MemoryAllocation const* allocation) -> bool {
+      if (! allocation->isOwnSignatureValid()) {
+        // freed, but still queued for removal
+        return true;
+      }
+
+      return record(allocation->size, allocation->stack);
+    });
   }
+  else {
+    table_.visit([&] (BlockMetadata const& entry) -> bool {
+      return record(entry.size, entry.stack);
+    });
+  }
+
+  ::fclose(file);
+
+  Printer::EmitLine(OutFile,
+                    "# recorded %llu leak fingerprint(s) in '%s'",
+                    static_cast<unsigned long long>(numFingerprints),
+                    Config.recordLeaks);
 }
 
 // -----------------------------------------------------------------------------
@@ -640,6 +1831,12 @@ Tracker::CallocFuncType  Tracker::LibraryCalloc           = nullptr;
 
 Tracker::ReallocFuncType Tracker::LibraryRealloc          = nullptr;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library memalign() function
+////////////////////////////////////////////////////////////////////////////////
+
+Tracker::MemalignFuncType Tracker::LibraryMemalign        = nullptr;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief library free() function
 ////////////////////////////////////////////////////////////////////////////////
@@ -658,6 +1855,18 @@ Tracker::ExitFuncType    Tracker::LibraryExit             = nullptr;
 
 Tracker::ExitFuncType    Tracker::Library_Exit            = nullptr;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library pthread_create() function
+////////////////////////////////////////////////////////////////////////////////
+
+Tracker::PthreadCreateFuncType Tracker::LibraryPthreadCreate = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library dlclose() function
+////////////////////////////////////////////////////////////////////////////////
+
+Tracker::DlcloseFuncType Tracker::LibraryDlclose          = nullptr;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief tracker state
 ////////////////////////////////////////////////////////////////////////////////
@@ -694,3 +1903,27 @@ void*                    Tracker::UntrackedPointers[4096];
 
 size_t                   Tracker::UntrackedPointersLength = 0;
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class LouseScope
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                        constructors / destructors
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief marks the current thread as running louse's own code
+////////////////////////////////////////////////////////////////////////////////
+
+LouseScope::LouseScope () 
+  : previous_(InLouse) {
+  InLouse = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief restores the previous state of the current thread
+////////////////////////////////////////////////////////////////////////////////
+
+LouseScope::~LouseScope () {
+  InLouse = previous_;
+}
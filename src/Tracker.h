@@ -3,10 +3,12 @@
 #define LOUSE_TRACKER_H 1
 
 #include <regex.h>
+#include <pthread.h>
 
 #include "Configuration.h"
 #include "MemoryAllocation.h"
 #include "Heap.h"
+#include "MetadataTable.h"
 
 // -----------------------------------------------------------------------------
 // --SECTION--                                                     class Tracker
@@ -33,14 +35,18 @@ namespace debugging {
       };
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief typedefs for malloc(), calloc(), realloc() and free()
+/// @brief typedefs for malloc(), calloc(), realloc(), memalign(), free(), 
+/// exit(), pthread_create() and dlclose()
 ////////////////////////////////////////////////////////////////////////////////
 
       typedef void* (*MallocFuncType) (size_t);
       typedef void* (*CallocFuncType) (size_t, size_t);
       typedef void* (*ReallocFuncType) (void*, size_t);
+      typedef void* (*MemalignFuncType) (size_t, size_t);
       typedef void (*FreeFuncType) (void*);
       typedef void (*ExitFuncType) (int) __attribute__ ((noreturn));
+      typedef int (*PthreadCreateFuncType) (pthread_t*, pthread_attr_t const*, void* (*) (void*), void*);
+      typedef int (*DlcloseFuncType) (void*);
 
 // -----------------------------------------------------------------------------
 // --SECTION--                                        constructors / destructors
@@ -93,6 +99,12 @@ namespace debugging {
 
       static void* AllocateInitialMemory (size_t); 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate some untracked aligned memory
+////////////////////////////////////////////////////////////////////////////////
+
+      static void* AllocateInitialAlignedMemory (size_t, size_t);
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief free some untracked memory
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,12 +117,34 @@ namespace debugging {
 
       void* allocateMemory (size_t, MemoryAllocation::AccessType);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate aligned memory that is going to be tracked
+/// the alignment must be a power of two
+////////////////////////////////////////////////////////////////////////////////
+
+      void* allocateAlignedMemory (size_t, size_t, MemoryAllocation::AccessType);
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief free tracked memory
+/// this will already report errors. the size is only used for sized 
+/// deallocation methods, which pass the size of the block they free
+////////////////////////////////////////////////////////////////////////////////
+
+      void freeMemory (void*, MemoryAllocation::AccessType, size_t = 0);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize tracked memory
 /// this will already report errors
 ////////////////////////////////////////////////////////////////////////////////
 
-      void freeMemory (void*, MemoryAllocation::AccessType);
+      void* reallocateMemory (void*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief release the memory of a tracked block that was removed from the
+/// heap already
+////////////////////////////////////////////////////////////////////////////////
+
+      static void ReleaseMemory (MemoryAllocation*);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief get the size of a memory allocation
@@ -136,6 +170,72 @@ namespace debugging {
       
       bool mustSuppressLeak (char const*, regex_t*);
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate memory that is going to be tracked, without a header
+/// the block's metadata is kept in the metadata table
+////////////////////////////////////////////////////////////////////////////////
+
+      void* allocateWithoutHeader (size_t, MemoryAllocation::AccessType, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief add a freshly allocated memory block with a header to the heap
+////////////////////////////////////////////////////////////////////////////////
+
+      void* trackAllocation (MemoryAllocation*);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief capture the stacktrace for a new memory block of the given size
+/// and sequence number
+/// returns 0 if stack traces are turned off or the block was not sampled
+////////////////////////////////////////////////////////////////////////////////
+
+      uint32_t captureAllocationStack (size_t, uint64_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief free tracked memory that was allocated without a header
+////////////////////////////////////////////////////////////////////////////////
+
+      void freeWithoutHeader (void*, MemoryAllocation::AccessType, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize tracked memory that was allocated without a header
+////////////////////////////////////////////////////////////////////////////////
+
+      void* reallocateWithoutHeader (void*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize a block outside the size window
+////////////////////////////////////////////////////////////////////////////////
+
+      void* reallocateUntracked (void*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief resize memory by allocating a new block and copying the contents
+////////////////////////////////////////////////////////////////////////////////
+
+      void* reallocateByCopy (void*, size_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief report a deallocation of an unknown memory pointer
+////////////////////////////////////////////////////////////////////////////////
+
+      void reportInvalidPointer (void*, MemoryAllocation::AccessType);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief check a deallocation for a mismatching method, a wrong size passed
+/// to sized deallocation and buffer overruns
+////////////////////////////////////////////////////////////////////////////////
+
+      void checkDeallocation (void*, MemoryAllocation::AccessType, size_t,
+                              size_t, MemoryAllocation::AccessType, uint32_t,
+                              uint64_t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief prints the allocation site of a memory block
+////////////////////////////////////////////////////////////////////////////////
+
+      void emitAllocationSite (void*, MemoryAllocation::AccessType, uint32_t, uint64_t);
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief prints the current stacktrace
 ////////////////////////////////////////////////////////////////////////////////
@@ -149,17 +249,22 @@ namespace debugging {
       void emitStackTrace (void**);
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief print overall results for the linked list of memory blocks,
-/// starting with the argument
+/// @brief print overall results for all memory blocks on the heap
 ////////////////////////////////////////////////////////////////////////////////
 
       void emitResults (regex_t*);
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief print all leaks for the memory blocks, starting with the argument
+/// @brief print all leaks for the memory blocks saved in the heap snapshot
 ////////////////////////////////////////////////////////////////////////////////
 
-      void emitLeaks (MemoryAllocation const*, regex_t*); 
+      void emitLeaks (regex_t*); 
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief write the fingerprints of all leaks in the heap snapshot
+////////////////////////////////////////////////////////////////////////////////
+
+      void recordLeakFingerprints ();
 
 // -----------------------------------------------------------------------------
 // --SECTION--                                           public static variables
@@ -185,6 +290,12 @@ namespace debugging {
 
       static ReallocFuncType   LibraryRealloc;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library memalign() function
+////////////////////////////////////////////////////////////////////////////////
+
+      static MemalignFuncType  LibraryMemalign;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief library free() function
 ////////////////////////////////////////////////////////////////////////////////
@@ -203,6 +314,18 @@ namespace debugging {
 
       static ExitFuncType      Library_Exit;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library pthread_create() function
+////////////////////////////////////////////////////////////////////////////////
+
+      static PthreadCreateFuncType LibraryPthreadCreate;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief library dlclose() function
+////////////////////////////////////////////////////////////////////////////////
+
+      static DlcloseFuncType   LibraryDlclose;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief tracker state
 ////////////////////////////////////////////////////////////////////////////////
@@ -239,6 +362,13 @@ namespace debugging {
 
       Heap                     heap_;
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief the metadata table, used instead of the heap when running without
+/// headers
+////////////////////////////////////////////////////////////////////////////////
+
+      MetadataTable<BlockMetadata> table_;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief buffer for untracked pointers
 ////////////////////////////////////////////////////////////////////////////////
@@ -251,6 +381,33 @@ namespace debugging {
 
       static size_t            UntrackedPointersLength;
   };
+
+// -----------------------------------------------------------------------------
+// --SECTION--                                                  class LouseScope
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief marks the current thread as running louse's own code that 
+/// captures or prints stack traces, until the scope is left. allocations
+/// made by this code are still tracked, but get no stack trace
+////////////////////////////////////////////////////////////////////////////////
+
+  class LouseScope {
+
+    public:
+
+      LouseScope ();
+
+      ~LouseScope ();
+
+      LouseScope (LouseScope const&) = delete;
+
+      LouseScope& operator= (LouseScope const&) = delete;
+
+    private:
+
+      bool const previous_;
+  };
 }
 
 #endif
@@ -1,9 +1,13 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <dlfcn.h>
+#include <malloc.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <new>
 
+#include "StackResolver.h"
 #include "Tracker.h"
 
 // -----------------------------------------------------------------------------
@@ -16,6 +20,53 @@
 
 static debugging::Tracker Tracker;
 
+// -----------------------------------------------------------------------------
+// --SECTION--                                          private helper functions
+// -----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief whether or not a value is a power of two
+////////////////////////////////////////////////////////////////////////////////
+
+static inline bool IsPowerOfTwo (size_t value) {
+  return (value != 0 && (value & (value - 1)) == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief get the system's page size
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t PageSize () {
+  static size_t const pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  return pageSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief allocate aligned memory for the aligned allocation functions
+/// the alignment must be a power of two
+////////////////////////////////////////////////////////////////////////////////
+
+static void* AllocateAligned (size_t alignment, size_t size) {
+  if (debugging::Tracker::State == debugging::Tracker::STATE_UNINITIALIZED) {
+    debugging::Tracker::Initialize();
+  }
+
+  void* pointer;
+  if (debugging::Tracker::State == debugging::Tracker::STATE_TRACING) {
+    pointer = Tracker.allocateAlignedMemory(alignment, size, debugging::MemoryAllocation::TYPE_MALLOC);
+  }
+  else {
+    // like malloc(), so that free() recognizes the block later
+    pointer = debugging::Tracker::AllocateInitialAlignedMemory(alignment, size);
+  }
+
+  if (pointer == nullptr) {
+    errno = ENOMEM;
+  }
+
+  return pointer;
+}
+
 // -----------------------------------------------------------------------------
 // --SECTION--                                            library initialization
 // -----------------------------------------------------------------------------
@@ -35,7 +86,7 @@ __attribute__((constructor)) void InitLibrary () {
 /// @brief new
 ////////////////////////////////////////////////////////////////////////////////
 
-void* operator new (size_t size) throw(std::bad_alloc) {
+void* operator new (size_t size) {
   void* pointer = Tracker.allocateMemory(size, debugging::MemoryAllocation::TYPE_NEW);
 
   if (pointer == nullptr) {
@@ -49,15 +100,37 @@ void* operator new (size_t size) throw(std::bad_alloc) {
 /// @brief new nothrow
 ////////////////////////////////////////////////////////////////////////////////
 
-void* operator new (size_t size, std::nothrow_t const&) throw() {
+void* operator new (size_t size, std::nothrow_t const&) noexcept {
   return Tracker.allocateMemory(size, debugging::MemoryAllocation::TYPE_NEW);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned new
+////////////////////////////////////////////////////////////////////////////////
+
+void* operator new (size_t size, std::align_val_t alignment) {
+  void* pointer = Tracker.allocateAlignedMemory(static_cast<size_t>(alignment), size, debugging::MemoryAllocation::TYPE_NEW_ALIGNED);
+
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return pointer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned new nothrow
+////////////////////////////////////////////////////////////////////////////////
+
+void* operator new (size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return Tracker.allocateAlignedMemory(static_cast<size_t>(alignment), size, debugging::MemoryAllocation::TYPE_NEW_ALIGNED);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief new[]
 ////////////////////////////////////////////////////////////////////////////////
 
-void* operator new[] (size_t size) throw(std::bad_alloc) {
+void* operator new[] (size_t size) {
   void* pointer = Tracker.allocateMemory(size, debugging::MemoryAllocation::TYPE_NEW_ARRAY);
 
   if (pointer == nullptr) {
@@ -71,15 +144,37 @@ void* operator new[] (size_t size) throw(std::bad_alloc) {
 /// @brief new[] nothrow
 ////////////////////////////////////////////////////////////////////////////////
 
-void* operator new[] (size_t size, std::nothrow_t const&) throw() {
+void* operator new[] (size_t size, std::nothrow_t const&) noexcept {
   return Tracker.allocateMemory(size, debugging::MemoryAllocation::TYPE_NEW_ARRAY);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned new[]
+////////////////////////////////////////////////////////////////////////////////
+
+void* operator new[] (size_t size, std::align_val_t alignment) {
+  void* pointer = Tracker.allocateAlignedMemory(static_cast<size_t>(alignment), size, debugging::MemoryAllocation::TYPE_NEW_ARRAY_ALIGNED);
+
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return pointer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned new[] nothrow
+////////////////////////////////////////////////////////////////////////////////
+
+void* operator new[] (size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return Tracker.allocateAlignedMemory(static_cast<size_t>(alignment), size, debugging::MemoryAllocation::TYPE_NEW_ARRAY_ALIGNED);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief delete
 ////////////////////////////////////////////////////////////////////////////////
 
-void operator delete (void* pointer) throw() {
+void operator delete (void* pointer) noexcept {
   Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE);
 }
 
@@ -87,15 +182,47 @@ void operator delete (void* pointer) throw() {
 /// @brief delete nothrow
 ////////////////////////////////////////////////////////////////////////////////
 
-void operator delete (void* pointer, std::nothrow_t const&) throw() {
+void operator delete (void* pointer, std::nothrow_t const&) noexcept {
   Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sized delete
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete (void* pointer, size_t size) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_SIZED, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned delete
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete (void* pointer, std::align_val_t) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ALIGNED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned delete nothrow
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete (void* pointer, std::align_val_t, std::nothrow_t const&) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ALIGNED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sized aligned delete
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete (void* pointer, size_t size, std::align_val_t) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_SIZED_ALIGNED, size);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief delete[]
 ////////////////////////////////////////////////////////////////////////////////
 
-void operator delete[] (void* pointer) throw() {
+void operator delete[] (void* pointer) noexcept {
   Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY);
 }
 
@@ -103,10 +230,42 @@ void operator delete[] (void* pointer) throw() {
 /// @brief delete[] nothrow
 ////////////////////////////////////////////////////////////////////////////////
 
-void operator delete[] (void* pointer, std::nothrow_t const&) throw() {
+void operator delete[] (void* pointer, std::nothrow_t const&) noexcept {
   Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sized delete[]
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete[] (void* pointer, size_t size) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY_SIZED, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned delete[]
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete[] (void* pointer, std::align_val_t) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY_ALIGNED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief aligned delete[] nothrow
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete[] (void* pointer, std::align_val_t, std::nothrow_t const&) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY_ALIGNED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief sized aligned delete[]
+////////////////////////////////////////////////////////////////////////////////
+
+void operator delete[] (void* pointer, size_t size, std::align_val_t) noexcept {
+  Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_DELETE_ARRAY_SIZED_ALIGNED, size);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief malloc()
 ////////////////////////////////////////////////////////////////////////////////
@@ -196,21 +355,11 @@ void* realloc (void* pointer, size_t size) {
     return memory;
   }
     
-  size_t oldSize = Tracker.memorySize(pointer);
-
-  if (oldSize >= size) {
-    return pointer;
-  }
-
-  void* memory = Tracker.allocateMemory(size, debugging::MemoryAllocation::TYPE_MALLOC);
+  void* memory = Tracker.reallocateMemory(pointer, size);
 
   if (memory == nullptr) {
     errno = ENOMEM;
   }
-  else {
-    ::memcpy(memory, pointer, oldSize);
-    Tracker.freeMemory(pointer, debugging::MemoryAllocation::TYPE_FREE);
-  }
 
   return memory;
 }
@@ -240,25 +389,116 @@ void free (void* pointer) {
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief posix_memalign()
-/// this function is currently not supported, and calling it will result in
-/// program termination
 ////////////////////////////////////////////////////////////////////////////////
 
-// non-implemented functions
-int posix_memalign (void** /*memptr*/, size_t /*alignment*/, size_t /*size*/) {
-  debugging::Tracker::ImmediateAbort("assertion", "posix_memalign() is not handled");
+int posix_memalign (void** memptr, size_t alignment, size_t size) {
+  if (! IsPowerOfTwo(alignment) || alignment % sizeof(void*) != 0) {
+    return EINVAL;
+  }
+
+  int const saved = errno;
+  void* pointer = AllocateAligned(alignment, size);
+  // posix_memalign() reports errors via its result only
+  errno = saved;
+
+  if (pointer == nullptr) {
+    return ENOMEM;
+  }
+
+  *memptr = pointer;
   return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief aligned_alloc()
-/// this function is currently not supported, and calling it will result in
-/// program termination
 ////////////////////////////////////////////////////////////////////////////////
 
-void* aligned_alloc (size_t /*alignment*/, size_t /*size*/) {
-  debugging::Tracker::ImmediateAbort("assertion", "aligned_alloc() is not handled");
-  return nullptr;
+void* aligned_alloc (size_t alignment, size_t size) {
+  if (! IsPowerOfTwo(alignment)) {
+    errno = EINVAL;
+    return nullptr;
+  }
+
+  return AllocateAligned(alignment, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief memalign()
+/// an alignment that is not a power of two is rounded up to the next one, 
+/// as glibc does
+////////////////////////////////////////////////////////////////////////////////
+
+void* memalign (size_t alignment, size_t size) {
+  if (! IsPowerOfTwo(alignment)) {
+    if (alignment > (SIZE_MAX >> 1)) {
+      errno = EINVAL;
+      return nullptr;
+    }
+
+    size_t value = 1;
+
+    while (value < alignment) {
+      value <<= 1;
+    }
+    alignment = value;
+  }
+
+  return AllocateAligned(alignment, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief valloc()
+////////////////////////////////////////////////////////////////////////////////
+
+void* valloc (size_t size) {
+  return AllocateAligned(PageSize(), size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief pvalloc()
+/// the size is rounded up to a multiple of the page size
+////////////////////////////////////////////////////////////////////////////////
+
+void* pvalloc (size_t size) {
+  size_t const pageSize = PageSize();
+
+  size = (size == 0) ? pageSize : (size + pageSize - 1) & ~(pageSize - 1);
+
+  return AllocateAligned(pageSize, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief pthread_create()
+/// the heap runs without locking until the first additional thread is 
+/// started
+////////////////////////////////////////////////////////////////////////////////
+
+int pthread_create (pthread_t* thread, pthread_attr_t const* attr, void* (*start) (void*), void* arg) {
+  if (debugging::Tracker::State == debugging::Tracker::STATE_UNINITIALIZED) {
+    debugging::Tracker::Initialize();
+  }
+
+  // the new thread sees the flag, as pthread_create() synchronizes with it
+  debugging::Heap::MultiThreaded.store(true, std::memory_order_release);
+
+  return debugging::Tracker::LibraryPthreadCreate(thread, attr, start, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief dlclose()
+/// the code ranges of the unloaded module may be reused by other modules
+////////////////////////////////////////////////////////////////////////////////
+
+int dlclose (void* handle) {
+  if (debugging::Tracker::State == debugging::Tracker::STATE_UNINITIALIZED) {
+    debugging::Tracker::Initialize();
+  }
+
+  int result = debugging::Tracker::LibraryDlclose(handle);
+
+  debugging::StackResolver::RefreshModules();
+
+  return result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////